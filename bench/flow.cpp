@@ -0,0 +1,178 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <asd_progetto2021/dataset/limits.hpp>
+#include <asd_progetto2021/opt/bipartite_matching.hpp>
+#include <asd_progetto2021/opt/flow.hpp>
+
+// Compares the min cost flow engines on random weighted stone/city graphs shaped like
+// find_matching_heavy: every stone is found in `degree` random cities and the cost of a match
+// grows with the stone weight and the position of the city in the tour. Prints csv.
+
+struct WeightedEdge
+{
+  int stone;
+  int city;
+  int cost;
+};
+
+inline auto random_graph (int num_stones, int num_cities, int degree, unsigned seed) -> std::vector<WeightedEdge>
+{
+  auto rng = std::mt19937 (seed);
+  auto edges = std::vector<WeightedEdge> ();
+  for (int i = 0; i < num_stones; ++i) {
+    auto const weight = (int)(rng () % MAX_STONE_WEIGHT) + 1;
+    for (int d = 0; d < degree; ++d) {
+      auto const city = (int)(rng () % num_cities);
+      edges.push_back ({i, city, (int)std::min (1ll * (num_cities - city + 1) * weight, 10000000ll)});
+    }
+  }
+  return edges;
+}
+
+template<class Engine>
+inline auto flow_matching (int num_stones, int num_cities, std::vector<WeightedEdge> const& edges) -> long long
+{
+  auto const src = num_stones + num_cities;
+  auto const sink = src + 1;
+  auto flow = Engine (num_stones + num_cities + 2);
+  for (int i = 0; i < num_stones; ++i)
+    flow.add (src, i, 1, 0);
+  for (int j = 0; j < num_cities; ++j)
+    flow.add (num_stones + j, sink, 1, 0);
+  for (auto const& e : edges)
+    flow.add (e.stone, num_stones + e.city, 1, e.cost);
+  return flow.solve (src, sink).second;
+}
+
+inline auto assignment_matching (int num_stones, int num_cities, std::vector<WeightedEdge> const& edges) -> long long
+{
+  auto bip = BipartiteMatching::Assignment (num_stones, num_cities);
+  for (auto const& e : edges)
+    bip.add (e.stone, e.city, e.cost);
+  return bip.solve ().second;
+}
+
+inline auto auction_matching (int num_stones, int num_cities, std::vector<WeightedEdge> const& edges, ThreadPool* pool)
+  -> long long
+{
+  auto bip = BipartiteMatching::Auction (num_stones, num_cities, pool);
+  for (auto const& e : edges)
+    bip.add (e.stone, e.city, e.cost);
+  return bip.solve ().second;
+}
+
+template<class Fn>
+inline auto time_ms (Fn fn, long long& result) -> double
+{
+  auto const start = std::chrono::steady_clock::now ();
+  result = fn ();
+  auto const elapsed = std::chrono::steady_clock::now () - start;
+  return std::chrono::duration<double, std::milli> (elapsed).count ();
+}
+
+// Small random instances, where the auction runs many phases of few rounds: the matchings must
+// have the size of the min cost flow, and its cost when every stone is matched (the stones that
+// give up are not chosen by cost). Returns the number of mismatches.
+inline auto check_auction (int instances) -> int
+{
+  auto rng = std::mt19937 (2);
+  auto mismatches = 0;
+  for (int k = 0; k < instances; ++k) {
+    auto const n = 5 + (int)(rng () % 60);
+    auto const edges = random_graph (n, n, 4, rng ());
+
+    auto const src = 2 * n, sink = src + 1;
+    auto flow = Flow::WeightedDinic (2 * n + 2);
+    for (int i = 0; i < n; ++i) {
+      flow.add (src, i, 1, 0);
+      flow.add (n + i, sink, 1, 0);
+    }
+    for (auto const& e : edges)
+      flow.add (e.stone, n + e.city, 1, e.cost);
+    auto const expected = flow.solve (src, sink);
+
+    auto bip = BipartiteMatching::Auction (n, n);
+    for (auto const& e : edges)
+      bip.add (e.stone, e.city, e.cost);
+    auto const found = bip.solve ();
+
+    if (found.first != expected.first || (expected.first == n && found.second != expected.second)) {
+      fprintf (stderr,
+        "auction mismatch on %d stones: %d matched at cost %lld instead of %d at cost %lld\n",
+        n,
+        found.first,
+        found.second,
+        expected.first,
+        expected.second);
+      ++mismatches;
+    }
+  }
+  return mismatches;
+}
+
+int main ()
+{
+  struct Config
+  {
+    int num_stones;
+    int num_cities;
+    int degree;
+  };
+
+  // the assignment and the auction only match every stone when stones <= cities
+  auto const configs = std::vector<Config> {
+    {200, 200, 10},
+    {1000, 1000, 20},
+    {2000, 2000, 20},
+    {2000, 2000, 200},
+    {5000, 2000, 10},
+    {MAX_STONES, MAX_CITIES, 5},
+    {MAX_STONES, MAX_CITIES, 50},
+  };
+
+  auto pool = ThreadPool ();
+
+  printf ("stones,cities,edges,weighted_dinic_ms,cost_scaling_ms,assignment_ms,auction_ms,parallel_auction_ms,cost\n");
+  for (auto const& config : configs) {
+    auto const edges = random_graph (config.num_stones, config.num_cities, config.degree, 1);
+
+    auto dinic_cost = 0ll, scaling_cost = 0ll, assignment_cost = -1ll;
+    auto const dinic_ms = time_ms (
+      [&] () { return flow_matching<Flow::WeightedDinic> (config.num_stones, config.num_cities, edges); }, dinic_cost);
+    auto const scaling_ms = time_ms (
+      [&] () { return flow_matching<Flow::CostScaling> (config.num_stones, config.num_cities, edges); }, scaling_cost);
+
+    auto assignment_ms = -1.0, auction_ms = -1.0, parallel_auction_ms = -1.0;
+    auto auction_cost = -1ll, parallel_auction_cost = -1ll;
+    if (config.num_stones <= config.num_cities) {
+      assignment_ms = time_ms (
+        [&] () { return assignment_matching (config.num_stones, config.num_cities, edges); }, assignment_cost);
+      auction_ms = time_ms (
+        [&] () { return auction_matching (config.num_stones, config.num_cities, edges, nullptr); }, auction_cost);
+      parallel_auction_ms = time_ms (
+        [&] () { return auction_matching (config.num_stones, config.num_cities, edges, &pool); },
+        parallel_auction_cost);
+    }
+
+    for (auto cost : {scaling_cost, assignment_cost, auction_cost, parallel_auction_cost})
+      if (cost != -1 && cost != dinic_cost)
+        fprintf (stderr, "cost mismatch: %lld instead of %lld\n", cost, dinic_cost);
+
+    printf ("%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%lld\n",
+      config.num_stones,
+      config.num_cities,
+      (int)edges.size (),
+      dinic_ms,
+      scaling_ms,
+      assignment_ms,
+      auction_ms,
+      parallel_auction_ms,
+      dinic_cost);
+  }
+
+  return check_auction (200) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <asd_progetto2021/dataset/io.hpp>
+#include <asd_progetto2021/solutions/general.hpp>
+#include <asd_progetto2021/solutions/no_tour.hpp>
+
+// Times the matching workloads of find_matching and solve_no_tour on the given inputs,
+// or on every input/inputN.txt when called without arguments. Prints csv.
+
+template<class Fn>
+inline auto time_ms (int repetitions, Fn fn) -> double
+{
+  auto const start = std::chrono::steady_clock::now ();
+  for (int i = 0; i < repetitions; ++i)
+    fn ();
+  auto const elapsed = std::chrono::steady_clock::now () - start;
+  return std::chrono::duration<double, std::milli> (elapsed).count () / repetitions;
+}
+
+template<class Matcher>
+inline auto match_selection (Dataset const& dataset, std::vector<int> const& selection) -> int
+{
+  auto bip = Matcher (selection.size (), dataset.num_cities ());
+  for (int i = 0; i < (int)selection.size (); ++i)
+    for (auto j : dataset.cities_with_stone (selection[i]))
+      bip.add (i, j);
+  return bip.solve ();
+}
+
+// Average cost of swapping a selected stone for an unselected one in an IncrementalMatching,
+// the move of a selection local search.
+inline auto incremental_swap_us (Dataset const& dataset, std::vector<int> const& selection, std::mt19937& rng) -> double
+{
+  auto bip = BipartiteMatching::IncrementalMatching (dataset.num_stones (), dataset.num_cities ());
+  for (auto i : selection)
+    bip.add_left (i, dataset.cities_with_stone (i).begin (), dataset.cities_with_stone (i).end ());
+
+  auto outside = std::vector<int> ();
+  for (int i = 0; i < dataset.num_stones (); ++i)
+    if (!bip.contains (i))
+      outside.push_back (i);
+  auto inside = selection;
+  if (inside.empty () || outside.empty ())
+    return -1.0;
+
+  auto const swaps = 10000;
+  return 1000.0 * time_ms (1, [&] () {
+    for (int k = 0; k < swaps; ++k) {
+      auto& x = inside[rng () % inside.size ()];
+      auto& y = outside[rng () % outside.size ()];
+      bip.remove_left (x);
+      bip.add_left (y, dataset.cities_with_stone (y).begin (), dataset.cities_with_stone (y).end ());
+      std::swap (x, y);
+    }
+  }) / swaps;
+}
+
+// Random graph at the size limits: every stone is found in a few random cities.
+template<class Matcher>
+inline auto match_random (int num_stones, int num_cities, int degree, unsigned seed) -> int
+{
+  auto rng = std::mt19937 (seed);
+  auto bip = Matcher (num_stones, num_cities);
+  for (int i = 0; i < num_stones; ++i)
+    for (int d = 0; d < degree; ++d)
+      bip.add (i, rng () % num_cities);
+  return bip.solve ();
+}
+
+int main (int argc, char** argv)
+{
+  auto paths = std::vector<std::string> (argv + 1, argv + argc);
+  if (paths.empty ())
+    for (int i = 0; i < 20; ++i)
+      paths.push_back (ASD_INPUT_DIR "/input" + std::to_string (i) + ".txt");
+
+  auto const repetitions = 20;
+  auto rng = std::mt19937 (0);
+
+  printf (
+    "input,stones,cities,selected,edges,kuhn_ms,hopcroft_karp_ms,push_relabel_ms,bit_matching_ms,"
+    "find_matching_ms,solve_no_tour_ms,"
+    "incremental_swap_us\n");
+  for (auto const& path : paths) {
+    auto is = fopen (path.c_str (), "r");
+    if (!is)
+      continue;
+    auto const data = read_dataset (is);
+    fclose (is);
+
+    auto const selection = select_knapsack (data, 1e9);
+    auto edges = 0ll;
+    for (auto i : selection)
+      edges += data.cities_with_stone (i).size ();
+
+    auto const kuhn_ms = time_ms (repetitions, [&] () { //
+      match_selection<BipartiteMatching::Kuhn> (data, selection);
+    });
+    auto const hopcroft_karp_ms = time_ms (repetitions, [&] () {
+      match_selection<BipartiteMatching::HopcroftKarp> (data, selection);
+    });
+    auto const push_relabel_ms = time_ms (repetitions, [&] () {
+      match_selection<BipartiteMatching::MaxCardinalityBipartiteMatching> (data, selection);
+    });
+    auto const bit_matching_ms = time_ms (repetitions, [&] () {
+      match_selection<BipartiteMatching::BitMatching> (data, selection);
+    });
+    auto const find_matching_ms = time_ms (repetitions, [&] () { //
+      find_matching (data, selection);
+    });
+
+    // solve_no_tour only supports selections smaller than the number of cities
+    auto solve_no_tour_ms = -1.0;
+    if ((int)selection.size () < data.num_cities ())
+      solve_no_tour_ms = time_ms (repetitions, [&] () { solve_no_tour (data, rng, 0.0); });
+
+    auto const swap_us = incremental_swap_us (data, selection, rng);
+
+    printf ("%s,%d,%d,%d,%lld,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+      path.c_str (),
+      data.num_stones (),
+      data.num_cities (),
+      (int)selection.size (),
+      edges,
+      kuhn_ms,
+      hopcroft_karp_ms,
+      push_relabel_ms,
+      bit_matching_ms,
+      find_matching_ms,
+      solve_no_tour_ms,
+      swap_us);
+  }
+
+  // the balanced graphs are not real instances, but the greedy leaves many free vertices on them
+  printf ("\nstones,cities,degree,kuhn_ms,hopcroft_karp_ms,push_relabel_ms,bit_matching_ms\n");
+  for (auto num_cities : {MAX_CITIES, MAX_STONES}) {
+    for (auto degree : {1, 2, 4, 16}) {
+      auto const kuhn_ms = time_ms (5, [&] () { //
+        match_random<BipartiteMatching::Kuhn> (MAX_STONES, num_cities, degree, 1);
+      });
+      auto const hopcroft_karp_ms = time_ms (5, [&] () {
+        match_random<BipartiteMatching::HopcroftKarp> (MAX_STONES, num_cities, degree, 1);
+      });
+      auto const push_relabel_ms = time_ms (5, [&] () {
+        match_random<BipartiteMatching::MaxCardinalityBipartiteMatching> (MAX_STONES, num_cities, degree, 1);
+      });
+      auto const bit_matching_ms = time_ms (5, [&] () {
+        match_random<BipartiteMatching::BitMatching> (MAX_STONES, num_cities, degree, 1);
+      });
+      printf ("%d,%d,%d,%.4f,%.4f,%.4f,%.4f\n",
+        MAX_STONES,
+        num_cities,
+        degree,
+        kuhn_ms,
+        hopcroft_karp_ms,
+        push_relabel_ms,
+        bit_matching_ms);
+    }
+  }
+}
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <asd_progetto2021/dataset/evaluation.hpp>
+#include <asd_progetto2021/dataset/limits.hpp>
+#include <asd_progetto2021/opt/bipartite_matching.hpp>
+#include <asd_progetto2021/opt/flow.hpp>
+#include <asd_progetto2021/opt/knapsack.hpp>
+#include <asd_progetto2021/opt/knapsack_frontier.hpp>
+#include <asd_progetto2021/opt/tsp.hpp>
+#include <asd_progetto2021/utilities/perf_counters.hpp>
+#include <asd_progetto2021/utilities/thread_pool.hpp>
+
+// Throughput of the primitives in opt/ and of the route operations on synthetic inputs, at sizes
+// up to the limits. Every primitive is called until --min-ms milliseconds (default 200) were spent
+// in it, setup excluded. Prints csv, one row per primitive and size, where an op is:
+//   knapsack_forward_dp           a dp cell, size is the capacity
+//   knapsack_hirschberg_parallel  a cell of the top level dp, size is the capacity
+//   knapsack_frontier             a selection without 1 to 3 random items, size is the capacity
+//   weighted_dinic                an edge of the matching graph, size is the number of stones
+//   hopcroft_karp                 an edge of the matching graph, size is the number of stones
+//   tsp_opt2, tsp_opt3            a move on a random tour, size is the number of cities
+//   route_reverse                 a reversal of a random segment, size is the number of cities
+//   evaluate                      an evaluation of a route, size is the number of cities
+// With --perf, the hardware counters per op are added, left empty for the events that
+// perf_event_open can't count on this machine.
+// The exit code is 1 when knapsack_hirschberg_parallel selects other items than knapsack_hirschberg,
+// or when a KnapsackFrontier selection is worth less than knapsack_forward_dp without the same items.
+
+struct Sample
+{
+  long long ops;
+  double ns;
+  PerfSample perf;
+};
+
+// Times fn, which runs ops ops, and counts its hardware events.
+template<class Fn>
+inline auto timed (PerfCounters& counters, long long ops, Fn fn) -> Sample
+{
+  counters.start ();
+  auto const start = std::chrono::steady_clock::now ();
+  fn ();
+  auto const elapsed = std::chrono::steady_clock::now () - start;
+  auto const perf = counters.stop ();
+  return Sample {ops, std::chrono::duration<double, std::nano> (elapsed).count (), perf};
+}
+
+// Repeats fn, which returns the sample it timed, until min_ms were timed.
+template<class Fn>
+inline auto measure (char const* primitive, int size, double min_ms, bool with_perf, Fn fn) -> void
+{
+  auto total = fn ();
+  while (total.ns < min_ms * 1e6) {
+    auto const sample = fn ();
+    total.ops += sample.ops;
+    total.ns += sample.ns;
+    total.perf += sample.perf;
+  }
+  printf ("%s,%d,%lld,%.3f,%.0f", primitive, size, total.ops, total.ns / total.ops, total.ops * 1e9 / total.ns);
+  if (with_perf)
+    for (auto value : total.perf.values)
+      value < 0 ? printf (",") : printf (",%.3f", (double)value / total.ops);
+  printf ("\n");
+  fflush (stdout);
+}
+
+struct Edge
+{
+  int stone;
+  int city;
+  int cost;
+};
+
+// Every stone is found in `degree` random cities, the costs are in [1, MAX_DISTANCE].
+inline auto random_graph (int num_stones, int num_cities, int degree, std::mt19937& rng) -> std::vector<Edge>
+{
+  auto edges = std::vector<Edge> ();
+  for (int i = 0; i < num_stones; ++i)
+    for (int d = 0; d < degree; ++d)
+      edges.push_back ({i, (int)(rng () % num_cities), (int)(rng () % MAX_DISTANCE) + 1});
+  return edges;
+}
+
+// Random distances and stones, every stone in `degree` random cities.
+inline auto random_dataset (int num_cities, int num_stones, int degree, std::mt19937& rng) -> Dataset
+{
+  auto graph = CompleteSymmetricGraph (num_cities);
+  for (int i = 1; i < num_cities; ++i)
+    for (int j = 0; j < i; ++j)
+      graph.distance (i, j) = rng () % MAX_DISTANCE + 1;
+
+  auto stones = StoneIndex (num_stones, num_cities);
+  for (int i = 0; i < num_stones; ++i) {
+    stones.stone (i) = Stone (rng () % MAX_STONE_WEIGHT + 1, rng () % MAX_STONE_ENERGY + 1);
+    for (int d = 0; d < degree; ++d)
+      stones.store (i, rng () % num_cities);
+  }
+
+  return Dataset (std::move (graph), std::move (stones), Glove (MAX_GLOVE_CAPACITY, 1.0), 0, 1.0, MAX_VELOCITY);
+}
+
+inline auto random_tour (int n, std::mt19937& rng) -> std::vector<int>
+{
+  auto tour = std::vector<int> (n);
+  std::iota (tour.begin (), tour.end (), 0);
+  std::shuffle (tour.begin (), tour.end (), rng);
+  return tour;
+}
+
+int main (int argc, char** argv)
+{
+  auto min_ms = 200.0;
+  auto perf = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp (argv[i], "--min-ms") == 0 && i + 1 < argc)
+      min_ms = std::atof (argv[i + 1]);
+    if (std::strcmp (argv[i], "--perf") == 0)
+      perf = true;
+  }
+
+  auto counters = PerfCounters (perf);
+  if (perf && !counters.any_available ())
+    fprintf (stderr, "perf events are not available, the counters are left empty\n");
+
+  auto rng = std::mt19937 (1);
+  auto pool = ThreadPool ();
+  auto workspaces = Knapsack::ParallelKnapsackWorkspace (pool);
+  auto mismatches = 0;
+
+  printf ("primitive,size,ops,ns_per_op,ops_per_sec");
+  if (perf)
+    for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+      printf (",%s_per_op", perf_event_name ((PerfEvent)i));
+  printf ("\n");
+
+  // 100 items light enough to sweep most of the capacity
+  for (auto capacity : {1000, 10000, 100000, 1000000, MAX_GLOVE_CAPACITY}) {
+    auto weights = std::vector<int> (100);
+    for (auto& w : weights)
+      w = rng () % std::min (capacity, MAX_STONE_WEIGHT) + 1;
+    auto indices = std::vector<int> (weights.size ());
+    std::iota (indices.begin (), indices.end (), 0);
+    auto dp = std::vector<long long> (capacity + 1);
+
+    auto cells = 0ll;
+    for (auto w : weights)
+      cells += capacity - w + 1;
+
+    measure ("knapsack_forward_dp", capacity, min_ms, perf, [&] () {
+      return timed (counters, cells, [&] () {
+        Knapsack::knapsack_forward_dp (
+          capacity,
+          indices.begin (),
+          indices.end (),
+          [&] (int id) { return weights[id]; },
+          [&] (int id) { return 1ll + id; },
+          dp.data ());
+      });
+    });
+
+    auto const weight_fn = [&] (int id) { return weights[id]; };
+    auto const value_fn = [&] (int id) { return 1ll + id; };
+    auto const expected = Knapsack::knapsack_hirschberg (capacity, indices.begin (), indices.end (), weight_fn, value_fn);
+    auto const found = Knapsack::knapsack_hirschberg_parallel (
+      pool, workspaces, capacity, indices.begin (), indices.end (), weight_fn, value_fn);
+    if (found.selection != expected.selection || found.value != expected.value) {
+      fprintf (stderr, "knapsack_hirschberg_parallel differs from knapsack_hirschberg at capacity %d\n", capacity);
+      mismatches++;
+    }
+
+    measure ("knapsack_hirschberg_parallel", capacity, min_ms, perf, [&] () {
+      return timed (counters, 1ll * (capacity + 1) * indices.size (), [&] () {
+        Knapsack::knapsack_hirschberg_parallel (
+          pool, workspaces, capacity, indices.begin (), indices.end (), weight_fn, value_fn);
+      });
+    });
+  }
+
+  // the queries of a search loop, which drops a few stones and asks for the best selection left
+  for (auto capacity : {1000, 10000, 100000}) {
+    auto weights = std::vector<int> (100);
+    for (auto& w : weights)
+      w = rng () % std::min (capacity, MAX_STONE_WEIGHT) + 1;
+    auto indices = std::vector<int> (weights.size ());
+    std::iota (indices.begin (), indices.end (), 0);
+    auto const weight_fn = [&] (int id) { return weights[id]; };
+    auto const value_fn = [&] (int id) { return 1ll + id; };
+    auto frontier = Knapsack::KnapsackFrontier (capacity, indices.begin (), indices.end (), weight_fn, value_fn);
+
+    auto const queries = 20;
+    auto excluded = std::vector<std::vector<int>> (queries);
+    for (auto& ids : excluded)
+      for (int k = rng () % 3; k >= 0; --k)
+        ids.push_back (rng () % indices.size ());
+
+    auto dp = std::vector<long long> (capacity + 1);
+    for (auto const& ids : excluded) {
+      auto left = std::vector<int> ();
+      for (auto id : indices)
+        if (std::find (ids.begin (), ids.end (), id) == ids.end ())
+          left.push_back (id);
+      Knapsack::knapsack_forward_dp (capacity, left.begin (), left.end (), weight_fn, value_fn, dp.data ());
+      auto const found = frontier.solve (capacity, ids);
+      auto value = 0ll;
+      auto takes_excluded = false;
+      for (auto id : found.selection)
+        value += value_fn (id), takes_excluded |= std::find (ids.begin (), ids.end (), id) != ids.end ();
+      if (takes_excluded || value != dp[capacity] || found.value != value || found.weight > capacity) {
+        fprintf (stderr, "KnapsackFrontier differs from knapsack_forward_dp at capacity %d\n", capacity);
+        mismatches++;
+      }
+    }
+
+    measure ("knapsack_frontier", capacity, min_ms, perf, [&] () {
+      return timed (counters, queries, [&] () {
+        for (auto const& ids : excluded)
+          frontier.solve (capacity, ids);
+      });
+    });
+  }
+
+  // the stone/city graphs of find_matching and find_matching_heavy, stones <= cities
+  for (auto num_stones : {100, 500, MAX_CITIES, MAX_STONES}) {
+    auto const num_cities = std::min (num_stones, MAX_CITIES);
+    auto const edges = random_graph (num_stones, num_cities, 5, rng);
+    auto const src = num_stones + num_cities, sink = src + 1;
+
+    measure ("weighted_dinic", num_stones, min_ms, perf, [&] () {
+      auto flow = Flow::WeightedDinic (num_stones + num_cities + 2);
+      for (int i = 0; i < num_stones; ++i)
+        flow.add (src, i, 1, 0);
+      for (int j = 0; j < num_cities; ++j)
+        flow.add (num_stones + j, sink, 1, 0);
+      for (auto const& e : edges)
+        flow.add (e.stone, num_stones + e.city, 1, e.cost);
+      return timed (counters, edges.size (), [&] () { flow.solve (src, sink); });
+    });
+
+    measure ("hopcroft_karp", num_stones, min_ms, perf, [&] () {
+      auto bip = BipartiteMatching::HopcroftKarp (num_stones, num_cities);
+      for (auto const& e : edges)
+        bip.add (e.stone, e.city);
+      return timed (counters, edges.size (), [&] () { bip.solve (); });
+    });
+  }
+
+  for (auto n : {100, 500, MAX_CITIES}) {
+    auto const data = random_dataset (n, MAX_STONES, 2, rng);
+    auto const dist_fn = [&] (int x, int y) { return data.distance (x, y); };
+    auto const moves = 100000;
+
+    // a fresh random tour for every batch, so that most moves are still improving
+    measure ("tsp_opt2", n, min_ms, perf, [&] () {
+      auto tour = random_tour (n, rng);
+      auto xs = std::vector<int> (2 * moves);
+      for (auto& x : xs)
+        x = rng () % n;
+      return timed (counters, moves, [&] () {
+        for (int k = 0; k < moves; ++k)
+          Tsp::tsp_opt2 (tour.data (), n, xs[2 * k], xs[2 * k + 1], dist_fn);
+      });
+    });
+
+    measure ("tsp_opt3", n, min_ms, perf, [&] () {
+      auto tour = random_tour (n, rng);
+      auto xs = std::vector<int> (3 * moves);
+      for (auto& x : xs)
+        x = rng () % n;
+      for (int k = 0; k < moves; ++k)
+        std::sort (xs.begin () + 3 * k, xs.begin () + 3 * k + 3);
+      return timed (counters, moves, [&] () {
+        for (int k = 0; k < moves; ++k)
+          Tsp::tsp_opt3 (tour.data (), n, xs[3 * k], xs[3 * k + 1], xs[3 * k + 2], dist_fn);
+      });
+    });
+
+    measure ("route_reverse", n, min_ms, perf, [&] () {
+      auto route = SimpleRoute (data);
+      auto xs = std::vector<int> (2 * moves);
+      for (auto& x : xs)
+        x = 1 + rng () % (n - 1);
+      for (int k = 0; k < moves; ++k)
+        if (xs[2 * k] > xs[2 * k + 1])
+          std::swap (xs[2 * k], xs[2 * k + 1]);
+      return timed (counters, moves, [&] () {
+        for (int k = 0; k < moves; ++k)
+          route.reverse (xs[2 * k], xs[2 * k + 1]);
+      });
+    });
+
+    // a random tour carrying every stone that fits in a free city
+    auto const tour = random_tour (n, rng);
+    auto order = tour;
+    std::rotate (order.begin (), std::find (order.begin (), order.end (), data.starting_city ()), order.end ());
+    auto const route = SimpleRoute (data, order.data (), order.data () + n);
+    auto matching = StoneMatching (data);
+    for (int i = 0; i < data.num_stones (); ++i) {
+      auto const city = data.cities_with_stone (i).front ();
+      if (!matching.is_city_matched (city) && matching.fits (data.stone (i).weight))
+        matching.match (i, city);
+    }
+
+    auto const evaluations = 1000;
+    auto checksum = 0.0;
+    measure ("evaluate", n, min_ms, perf, [&] () {
+      return timed (counters, evaluations, [&] () {
+        for (int k = 0; k < evaluations; ++k)
+          checksum += evaluate (route, matching).score;
+      });
+    });
+    if (checksum == 0.0)
+      fprintf (stderr, "no evaluation\n");
+  }
+
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
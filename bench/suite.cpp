@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <asd_progetto2021/dataset/io.hpp>
+#include <asd_progetto2021/solutions/dispatch.hpp>
+#include <asd_progetto2021/utilities/perf_counters.hpp>
+
+// Times the phases of a solution on the given inputs, or on every input/inputN.txt when called
+// without input arguments. Every input is read from disk once and parsed from memory, every run
+// uses its index as the seed. Prints the median and the 95th percentile of every phase as csv,
+// or json with --json, with the median score the solver reached within --budget ms.
+//
+//   bench_suite [--runs n] [--budget ms] [--json] [--perf] [--baseline old.csv] [--threshold 0.1] [inputs...]
+//
+// With --perf, the hardware counters of every phase are added, averaged over the runs. The events
+// that perf_event_open can't count on this machine are left empty.
+//
+// With a baseline, a previous csv output, the phases slower by more than the threshold and the
+// scores lower by more than the threshold are marked as regressions and the exit code is 1.
+// Differences under a tenth of a millisecond are never regressions.
+
+struct PhaseResult
+{
+  std::string input;
+  std::string solver;
+  std::string phase;
+  double median_ms;
+  double p95_ms;
+  bool has_score;
+  double score;
+
+  // from the baseline, when it has the same input and phase
+  bool has_baseline;
+  double baseline_ms;
+  double baseline_score;
+  bool regression;
+
+  // per run, when counted
+  PerfSample perf;
+};
+
+struct PhaseSamples
+{
+  std::vector<double> times;
+  PerfSample perf {};
+  bool first = true;
+};
+
+inline auto elapsed_ms (std::chrono::steady_clock::time_point start) -> double
+{
+  auto const elapsed = std::chrono::steady_clock::now () - start;
+  return std::chrono::duration<double, std::milli> (elapsed).count ();
+}
+
+// Runs fn and adds its time and its hardware counters to the samples, returns what fn returns.
+template<class Fn>
+inline auto run_phase (PhaseSamples& samples, PerfCounters& counters, Fn fn) -> decltype (fn ())
+{
+  counters.start ();
+  auto const start = std::chrono::steady_clock::now ();
+  auto result = fn ();
+  samples.times.push_back (elapsed_ms (start));
+
+  auto const perf = counters.stop ();
+  if (samples.first)
+    samples.perf = perf;
+  else
+    samples.perf += perf;
+  samples.first = false;
+  return result;
+}
+
+// Nearest rank percentile.
+inline auto percentile (std::vector<double> values, double p) -> double
+{
+  std::sort (values.begin (), values.end ());
+  auto const rank = (int)std::ceil (p * values.size ());
+  return values[std::max (0, std::min (rank, (int)values.size ()) - 1)];
+}
+
+inline auto read_file (std::string const& path, std::string& content) -> bool
+{
+  auto file = std::ifstream (path, std::ios::binary);
+  if (!file)
+    return false;
+  auto buffer = std::ostringstream ();
+  buffer << file.rdbuf ();
+  content = buffer.str ();
+  return true;
+}
+
+inline auto parse_dataset (std::string& content, std::uint64_t seed) -> Dataset
+{
+  auto is = fmemopen (&content[0], content.size (), "r");
+  auto data = read_dataset (is, seed);
+  fclose (is);
+  return data;
+}
+
+inline auto split_csv (std::string const& line) -> std::vector<std::string>
+{
+  auto fields = std::vector<std::string> ();
+  auto field = std::string ();
+  auto is = std::istringstream (line);
+  while (std::getline (is, field, ','))
+    fields.push_back (field);
+  return fields;
+}
+
+// Medians of a previous run by input and phase, read from the csv columns with those names.
+inline auto read_baseline (std::string const& path) -> std::map<std::string, std::pair<double, double>>
+{
+  auto result = std::map<std::string, std::pair<double, double>> ();
+  auto file = std::ifstream (path);
+  auto line = std::string ();
+  if (!std::getline (file, line)) {
+    fprintf (stderr, "cannot read the baseline %s\n", path.c_str ());
+    return result;
+  }
+
+  auto const header = split_csv (line);
+  auto const column = [&] (char const* name) {
+    return (int)(std::find (header.begin (), header.end (), name) - header.begin ());
+  };
+  auto const input = column ("input"), phase = column ("phase");
+  auto const median_ms = column ("median_ms"), score = column ("score");
+
+  while (std::getline (file, line)) {
+    auto const fields = split_csv (line);
+    auto const field = [&] (int i) { return i < (int)fields.size () ? fields[i] : std::string (); };
+    if (field (input).empty () || field (median_ms).empty ())
+      continue;
+    auto const score_field = field (score);
+    result[field (input) + "," + field (phase)] = {std::atof (field (median_ms).c_str ()),
+      score_field.empty () ? NAN : std::atof (score_field.c_str ())};
+  }
+  return result;
+}
+
+inline auto print_csv (std::vector<PhaseResult> const& results, bool with_baseline, bool with_perf) -> void
+{
+  printf ("input,solver,phase,median_ms,p95_ms,score");
+  if (with_baseline)
+    printf (",baseline_ms,delta_pct,baseline_score,regression");
+  if (with_perf)
+    for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+      printf (",%s", perf_event_name ((PerfEvent)i));
+  printf ("\n");
+
+  for (auto const& r : results) {
+    printf ("%s,%s,%s,%.4f,%.4f,", r.input.c_str (), r.solver.c_str (), r.phase.c_str (), r.median_ms, r.p95_ms);
+    if (r.has_score)
+      printf ("%.1f", r.score);
+    if (with_baseline && r.has_baseline) {
+      printf (",%.4f,%.1f,", r.baseline_ms, 100.0 * (r.median_ms / r.baseline_ms - 1.0));
+      if (!std::isnan (r.baseline_score))
+        printf ("%.1f", r.baseline_score);
+      printf (",%d", r.regression);
+    } else if (with_baseline) {
+      printf (",,,,0");
+    }
+    if (with_perf)
+      for (auto value : r.perf.values)
+        value < 0 ? printf (",") : printf (",%lld", value);
+    printf ("\n");
+  }
+}
+
+inline auto print_json (std::vector<PhaseResult> const& results, bool with_baseline, bool with_perf) -> void
+{
+  printf ("[\n");
+  for (int i = 0; i < (int)results.size (); ++i) {
+    auto const& r = results[i];
+    printf ("  {\"input\": \"%s\", \"solver\": \"%s\", \"phase\": \"%s\", \"median_ms\": %.4f, \"p95_ms\": %.4f",
+      r.input.c_str (),
+      r.solver.c_str (),
+      r.phase.c_str (),
+      r.median_ms,
+      r.p95_ms);
+    if (r.has_score)
+      printf (", \"score\": %.1f", r.score);
+    if (with_baseline && r.has_baseline) {
+      printf (", \"baseline_ms\": %.4f", r.baseline_ms);
+      if (!std::isnan (r.baseline_score))
+        printf (", \"baseline_score\": %.1f", r.baseline_score);
+      printf (", \"regression\": %s", r.regression ? "true" : "false");
+    }
+    if (with_perf)
+      for (int k = 0; k < NUM_PERF_EVENTS; ++k)
+        if (r.perf.values[k] >= 0)
+          printf (", \"%s\": %lld", perf_event_name ((PerfEvent)k), r.perf.values[k]);
+    printf ("}%s\n", i + 1 < (int)results.size () ? "," : "");
+  }
+  printf ("]\n");
+}
+
+int main (int argc, char** argv)
+{
+  auto runs = 5;
+  auto budget_ms = 1000.0;
+  auto json = false;
+  auto perf = false;
+  auto baseline_path = std::string ();
+  auto threshold = 0.1;
+  auto paths = std::vector<std::string> ();
+
+  for (int i = 1; i < argc; ++i) {
+    auto const has_value = i + 1 < argc;
+    if (std::strcmp (argv[i], "--runs") == 0 && has_value)
+      runs = std::max (1, std::atoi (argv[++i]));
+    else if (std::strcmp (argv[i], "--budget") == 0 && has_value)
+      budget_ms = std::atof (argv[++i]);
+    else if (std::strcmp (argv[i], "--baseline") == 0 && has_value)
+      baseline_path = argv[++i];
+    else if (std::strcmp (argv[i], "--threshold") == 0 && has_value)
+      threshold = std::atof (argv[++i]);
+    else if (std::strcmp (argv[i], "--json") == 0)
+      json = true;
+    else if (std::strcmp (argv[i], "--perf") == 0)
+      perf = true;
+    else
+      paths.push_back (argv[i]);
+  }
+
+  if (paths.empty ())
+    for (int i = 0; i < 20; ++i)
+      paths.push_back (ASD_INPUT_DIR "/input" + std::to_string (i) + ".txt");
+
+  auto counters = PerfCounters (perf);
+  if (perf && !counters.any_available ())
+    fprintf (stderr, "perf events are not available, the counters are left empty\n");
+
+  auto results = std::vector<PhaseResult> ();
+  for (auto const& path : paths) {
+    auto content = std::string ();
+    if (!read_file (path, content))
+      continue;
+
+    auto const name = path.substr (path.find_last_of ('/') + 1);
+    auto const kind = choose_solver (parse_dataset (content, 0));
+
+    auto phases = std::map<std::string, PhaseSamples> ();
+    auto scores = std::vector<double> ();
+
+    for (int run = 0; run < runs; ++run) {
+      auto rng = Random (run);
+      auto const data = run_phase (phases["parse"], counters, [&] () { return parse_dataset (content, run); });
+
+      auto const selection = run_phase (phases["knapsack"], counters, [&] () { return select_knapsack (data, 1e9); });
+      run_phase (phases["matching"], counters, [&] () { return find_matching (data, selection); });
+
+      auto const dist_fn = [&] (int x, int y) { return data.distance (x, y); };
+      auto tour = std::vector<int> (data.num_cities ());
+      std::iota (tour.begin (), tour.end (), 0);
+      run_phase (phases["tsp_construction"], counters, [&] () {
+        return Tsp::tsp_bootstrap_greedy (tour.data (), tour.size (), dist_fn, 8, rng);
+      });
+
+      // a fixed number of moves, Tsp::tsp runs them until its deadline
+      run_phase (phases["local_search"], counters, [&] () {
+        auto improved = 0;
+        for (int k = 0; k < 10000; ++k)
+          improved += Tsp::tsp_improve_random3 (tour.data (), tour.size (), dist_fn, rng);
+        return improved;
+      });
+
+      auto const sol = run_phase (phases["solve"], counters, [&] () { //
+        return solve_with (kind, data, rng, budget_ms);
+      });
+      scores.push_back (evaluate (sol.first, sol.second).score);
+
+      auto buffer = std::vector<char> (max_output_size (data));
+      run_phase (phases["output"], counters, [&] () {
+        return format_output (buffer.data (), sol.first, sol.second, evaluate (sol.first, sol.second));
+      });
+    }
+
+    for (auto phase : {"parse", "knapsack", "matching", "tsp_construction", "local_search", "solve", "output"}) {
+      auto const& samples = phases[phase];
+      auto const is_solve = std::strcmp (phase, "solve") == 0;
+
+      auto perf_per_run = samples.perf;
+      for (auto& value : perf_per_run.values)
+        if (value >= 0)
+          value /= runs;
+
+      results.push_back ({name,
+        solver_name (kind),
+        phase,
+        percentile (samples.times, 0.5),
+        percentile (samples.times, 0.95),
+        is_solve,
+        is_solve ? percentile (scores, 0.5) : 0.0,
+        false,
+        0.0,
+        0.0,
+        false,
+        perf_per_run});
+    }
+  }
+
+  // below a tenth of a millisecond the timings are mostly noise
+  auto const noise_ms = 0.1;
+  auto regressions = 0;
+  if (!baseline_path.empty ()) {
+    auto const baseline = read_baseline (baseline_path);
+    for (auto& r : results) {
+      auto const it = baseline.find (r.input + "," + r.phase);
+      if (it == baseline.end ())
+        continue;
+      r.has_baseline = true;
+      r.baseline_ms = it->second.first;
+      r.baseline_score = it->second.second;
+
+      // the solve phase always takes the budget, only its score can regress
+      if (r.has_score)
+        r.regression = !std::isnan (r.baseline_score)
+          && r.score < r.baseline_score - std::abs (r.baseline_score) * threshold;
+      else
+        r.regression = r.median_ms > r.baseline_ms * (1.0 + threshold) && r.median_ms - r.baseline_ms > noise_ms;
+      regressions += r.regression;
+    }
+  }
+
+  if (json)
+    print_json (results, !baseline_path.empty (), perf);
+  else
+    print_csv (results, !baseline_path.empty (), perf);
+
+  if (regressions > 0)
+    fprintf (stderr, "%d regressions over %.0f%%\n", regressions, 100.0 * threshold);
+  return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <asd_progetto2021/dataset/io.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+// Best solution published so far, kept formatted as the output so that a signal handler can
+// write it when the cpu time limit fires (SIGXCPU) or quick_exit is called.
+// publish formats into the buffer that is not current and then flips them. flush freezes
+// publishing before reading the current buffer, so a buffer is never written while it is read.
+struct AnytimeOutput
+{
+private:
+  int _fd;
+  std::vector<char> _buffers[2];
+  std::size_t _sizes[2] {};
+  double _best_score = -std::numeric_limits<double>::infinity ();
+  std::mutex _mutex;
+
+  std::atomic<int> _current {-1};
+  std::atomic<bool> _frozen {false};
+  std::atomic<bool> _written {false};
+
+  static auto installed () -> std::atomic<AnytimeOutput*>&
+  {
+    static std::atomic<AnytimeOutput*> output {nullptr};
+    return output;
+  }
+
+  static auto on_signal (int) -> void
+  {
+    auto const saved_errno = errno;
+    auto const output = installed ().load ();
+    if (output != nullptr && output->flush ())
+      _exit (EXIT_SUCCESS);
+    errno = saved_errno;
+  }
+
+  static auto on_quick_exit () -> void
+  {
+    auto const output = installed ().load ();
+    if (output != nullptr)
+      output->flush ();
+  }
+
+public:
+  AnytimeOutput (Dataset const& dataset, int fd) : _fd (fd)
+  {
+    _buffers[0].resize (max_output_size (dataset));
+    _buffers[1].resize (max_output_size (dataset));
+  }
+
+  AnytimeOutput (AnytimeOutput const&) = delete;
+  AnytimeOutput& operator= (AnytimeOutput const&) = delete;
+
+  ~AnytimeOutput ()
+  {
+    auto self = this;
+    installed ().compare_exchange_strong (self, nullptr);
+  }
+
+  // Makes SIGXCPU and quick_exit write the latest solution. Only one output can be installed.
+  auto install () -> void
+  {
+    installed () = this;
+
+    static auto const registered = std::at_quick_exit (on_quick_exit) == 0;
+    (void)registered;
+
+    struct sigaction action {};
+    action.sa_handler = on_signal;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGXCPU, &action, nullptr);
+  }
+
+  // Keeps the solution if it scores better than the published ones, returns true if it did.
+  // Can be called from many threads.
+  auto publish (SimpleRoute const& route, StoneMatching const& matching) -> bool
+  {
+    auto const eval = evaluate (route, matching);
+
+    std::lock_guard<std::mutex> lock (_mutex);
+    auto const current = _current.load ();
+    if (_frozen.load () || (current != -1 && eval.score <= _best_score))
+      return false;
+
+    auto const next = current == 0 ? 1 : 0;
+    _sizes[next] = format_output (_buffers[next].data (), route, matching, eval);
+    _best_score = eval.score;
+    _current.store (next);
+    return true;
+  }
+
+  // Writes the latest solution unless it was already written, returns true if it did.
+  // Async signal safe, publishing is over once called.
+  auto flush () -> bool
+  {
+    _frozen.store (true);
+    if (_written.exchange (true))
+      return false;
+
+    auto const current = _current.load ();
+    if (current == -1)
+      return false;
+
+    auto data = _buffers[current].data ();
+    auto left = _sizes[current];
+    while (left > 0) {
+      auto const written = write (_fd, data, left);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        return false;
+      data += written;
+      left -= written;
+    }
+    return true;
+  }
+};
@@ -2,6 +2,7 @@
 #include <asd_progetto2021/dataset/glove.hpp>
 #include <asd_progetto2021/dataset/graph.hpp>
 #include <asd_progetto2021/dataset/limits.hpp>
+#include <asd_progetto2021/dataset/profile.hpp>
 #include <asd_progetto2021/dataset/stone_index.hpp>
 #include <asd_progetto2021/utilities/assert.hpp>
 
@@ -14,6 +15,7 @@ private:
   CompleteSymmetricGraph _graph;
   StoneIndex _stones;
   Glove _glove;
+  DatasetProfile _profile;
 
   int _starting_city;
   double _min_velocity;
@@ -25,10 +27,12 @@ public:
     Glove glove,                         //
     int starting_city,                   //
     double min_velocity,                 //
-    double max_velocity)
+    double max_velocity,                 //
+    DatasetProfile profile)
     : _graph (std::move (graph)),     //
       _stones (std::move (stones)),   //
       _glove (glove),                 //
+      _profile (std::move (profile)), //
       _starting_city (starting_city), //
       _min_velocity (min_velocity),   //
       _max_velocity (max_velocity)
@@ -38,6 +42,18 @@ public:
     ASSERT (_max_velocity >= _min_velocity && _max_velocity <= MAX_VELOCITY);
   }
 
+  // Computes the profile from the graph and the stones.
+  Dataset (CompleteSymmetricGraph graph, //
+    StoneIndex stones,                   //
+    Glove glove,                         //
+    int starting_city,                   //
+    double min_velocity,                 //
+    double max_velocity)
+    : Dataset (std::move (graph), std::move (stones), glove, starting_city, min_velocity, max_velocity, {})
+  {
+    _profile = profile_of (_graph, _stones);
+  }
+
   Dataset (Dataset const&) = delete;
   Dataset (Dataset&&) = default;
 
@@ -76,6 +92,11 @@ public:
     return _starting_city;
   }
 
+  auto profile () const -> DatasetProfile const&
+  {
+    return _profile;
+  }
+
   // --- Graph information
 
   auto graph () const -> CompleteSymmetricGraph const&
@@ -1,7 +1,11 @@
 #pragma once
 #include <asd_progetto2021/dataset/evaluation.hpp>
+#include <asd_progetto2021/utilities/random.hpp>
+#include <asd_progetto2021/utilities/trace.hpp>
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <vector>
 
@@ -9,21 +13,21 @@ template<class Fn>
 using optional_result_t = typename decltype (std::declval<Fn&> () ())::first_type;
 
 template<class Fn>
-inline auto reservoir_sampling (int k, Fn fn) -> std::vector<optional_result_t<Fn>>
+inline auto reservoir_sampling (int k, Fn fn, std::uint64_t seed = 0) -> std::vector<optional_result_t<Fn>>
 {
   ASSERT (k > 0);
 
   auto result = std::vector<optional_result_t<Fn>> ();
   result.reserve (k);
 
-  auto rng = std::mt19937 (std::random_device {}());
+  auto rng = Random (seed, PARSING_STREAM);
   auto curr = fn ();
   int index = 0;
   while (curr.first) {
     if ((int)result.size () < k) {
       result.push_back (std::move (curr.second));
     } else {
-      auto replaced = rng () % index;
+      auto const replaced = (int)random_below (rng, index);
       if (replaced < k)
         result[replaced] = std::move (curr.second);
     }
@@ -52,8 +56,11 @@ inline auto fast_double (FILE* is) -> double
   return result;
 }
 
-inline auto read_dataset (FILE* is) -> Dataset
+// Stones found in more than 6M cities in total are sampled with the parsing stream of seed.
+inline auto read_dataset (FILE* is, std::uint64_t seed = 0) -> Dataset
 {
+  TRACE_SPAN ("read_dataset");
+
   int num_cities = fast_uint (is);
   int starting_city = fast_uint (is);
 
@@ -64,23 +71,26 @@ inline auto read_dataset (FILE* is) -> Dataset
   double max_velocity = fast_double (is);
 
   auto sample_size = 6000000;
-  auto rng = std::mt19937 (std::random_device {}());
+  auto rng = Random (seed, PARSING_STREAM);
   auto edges = std::vector<std::pair<std::int16_t, std::int16_t>> ();
 
   auto const reservoir_add = [&rng, &edges] (int sample_size, int index, int from, int to) {
     if (index < sample_size) {
       edges.emplace_back (from, to);
     } else {
-      auto replaced = rng () % index;
+      auto const replaced = (int)random_below (rng, index);
       if (replaced < sample_size)
         edges[replaced] = {from, to};
     }
   };
 
+  auto profile = DatasetProfile ();
+
   auto stones = StoneIndex (num_stones, num_cities);
   for (auto& stone : stones) {
     stone.weight = fast_uint (is);
     stone.energy = fast_uint (is);
+    profile.total_weight += stone.weight;
   }
 
   int edge_index = 0;
@@ -100,35 +110,95 @@ inline auto read_dataset (FILE* is) -> Dataset
     stones.store (e.first, e.second);
   edges = {};
 
+  profile.degree_histogram.assign (num_cities + 1, 0);
+  for (int stone_id = 0; stone_id < num_stones; ++stone_id) {
+    auto const degree = (int)stones.cities_with_stone (stone_id).size ();
+    profile.degree_histogram[std::min (degree, num_cities)]++;
+    profile.max_stone_degree = std::max (profile.max_stone_degree, degree);
+    profile.reachable_stones += degree > 0;
+  }
+
   auto graph = CompleteSymmetricGraph (num_cities);
-  for (int city_id = 1; city_id < num_cities; ++city_id)
-    for (int other = 0; other < city_id; ++other)
-      graph.distance (city_id, other) = fast_uint (is);
+  auto total_distance = 0ll;
+  auto min_distance = std::numeric_limits<int>::max ();
+  auto max_distance = 0;
+  for (int city_id = 1; city_id < num_cities; ++city_id) {
+    for (int other = 0; other < city_id; ++other) {
+      int const distance = fast_uint (is);
+      graph.distance (city_id, other) = distance;
+      total_distance += distance;
+      min_distance = std::min (min_distance, distance);
+      max_distance = std::max (max_distance, distance);
+    }
+  }
+  if (num_cities > 1) {
+    profile.constant_distance = min_distance == max_distance;
+    profile.min_distance = min_distance;
+    profile.max_distance = max_distance;
+    profile.mean_distance = total_distance / (num_cities * (num_cities - 1) / 2.0);
+  }
 
   return Dataset (std::move (graph), //
     std::move (stones),
     Glove (glove_capacity, glove_resistance),
     starting_city,
     min_velocity,
-    max_velocity);
+    max_velocity,
+    std::move (profile));
 }
 
-inline auto write_output (FILE* os, SimpleRoute const& route, StoneMatching const& matching) -> void
+// Upper bound on the size of the output for dataset: the first line, then at most 5 characters
+// for every stone and every city.
+inline auto max_output_size (Dataset const& dataset) -> std::size_t
 {
-  auto const eval = evaluate (route, matching);
+  return 128 + 5 * (dataset.num_stones () + dataset.num_cities () + 1) + 8;
+}
 
-  fprintf (os, "%lf %d %lf\n", eval.score, eval.energy, eval.travel_time);
+inline auto format_uint (char* out, int value) -> char*
+{
+  char digits[12];
+  int size = 0;
+  do {
+    digits[size++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (size > 0)
+    *out++ = digits[--size];
+  return out;
+}
+
+// Formats the output for the solution into out, which must hold max_output_size bytes.
+// Returns the number of bytes written.
+inline auto format_output (char* out, SimpleRoute const& route, StoneMatching const& matching, Evaluation const& eval)
+  -> std::size_t
+{
+  auto const first = out;
+  out += snprintf (out, 128, "%lf %d %lf\n", eval.score, eval.energy, eval.travel_time);
 
   for (int stone_id = 0; stone_id < route.dataset ().num_stones (); ++stone_id) {
     if (matching.is_stone_matched (stone_id)) {
-      fprintf (os, "%d ", matching.matched_city (stone_id));
+      out = format_uint (out, matching.matched_city (stone_id));
+      *out++ = ' ';
     } else {
-      fprintf (os, "-1 ");
+      *out++ = '-', *out++ = '1', *out++ = ' ';
     }
   }
-  fprintf (os, "\n");
+  *out++ = '\n';
+
+  route.for_each_edge ([&] (int from, int to) {
+    out = format_uint (out, from);
+    *out++ = ' ';
+  });
+  out = format_uint (out, route.dataset ().starting_city ());
+  for (auto c : {'\n', '*', '*', '*', '\n'})
+    *out++ = c;
 
-  route.for_each_edge ([&] (int from, int to) //
-    { fprintf (os, "%d ", from); });
-  fprintf (os, "%d\n***\n", route.dataset ().starting_city ());
+  return out - first;
+}
+
+inline auto write_output (FILE* os, SimpleRoute const& route, StoneMatching const& matching) -> void
+{
+  auto buffer = std::vector<char> (max_output_size (route.dataset ()));
+  auto const size = format_output (buffer.data (), route, matching, evaluate (route, matching));
+  fwrite (buffer.data (), 1, size, os);
 }
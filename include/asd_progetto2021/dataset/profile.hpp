@@ -0,0 +1,64 @@
+#pragma once
+#include <asd_progetto2021/dataset/graph.hpp>
+#include <asd_progetto2021/dataset/stone_index.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Statistics about a dataset, gathered by read_dataset while parsing, or by profile_of.
+// Stone degrees count the cities actually stored in the StoneIndex: stones heavier than the
+// glove capacity are stored nowhere.
+struct DatasetProfile
+{
+  // every pair of cities is at the same distance, also true with a single city
+  bool constant_distance = true;
+  int min_distance = 0;
+  int max_distance = 0;
+  double mean_distance = 0.0;
+
+  // degree_histogram[d] is the number of stones found in d cities
+  std::vector<int> degree_histogram {};
+  int max_stone_degree = 0;
+
+  long long total_weight = 0;
+
+  // stones found in at least one city, so not heavier than the glove capacity
+  int reachable_stones = 0;
+};
+
+// The profile of a dataset built without read_dataset, with the same statistics.
+inline auto profile_of (CompleteSymmetricGraph const& graph, StoneIndex const& stones) -> DatasetProfile
+{
+  auto profile = DatasetProfile ();
+  auto const num_cities = graph.num_cities ();
+
+  for (auto const& stone : stones)
+    profile.total_weight += stone.weight;
+
+  profile.degree_histogram.assign (num_cities + 1, 0);
+  for (int stone_id = 0; stone_id < stones.num_stones (); ++stone_id) {
+    auto const degree = (int)stones.cities_with_stone (stone_id).size ();
+    profile.degree_histogram[std::min (degree, num_cities)]++;
+    profile.max_stone_degree = std::max (profile.max_stone_degree, degree);
+    profile.reachable_stones += degree > 0;
+  }
+
+  if (num_cities > 1) {
+    auto total_distance = 0ll;
+    auto min_distance = std::numeric_limits<int>::max ();
+    auto max_distance = 0;
+    for (int city_id = 1; city_id < num_cities; ++city_id)
+      for (int other = 0; other < city_id; ++other) {
+        int const distance = graph.distance (city_id, other);
+        total_distance += distance;
+        min_distance = std::min (min_distance, distance);
+        max_distance = std::max (max_distance, distance);
+      }
+    profile.constant_distance = min_distance == max_distance;
+    profile.min_distance = min_distance;
+    profile.max_distance = max_distance;
+    profile.mean_distance = total_distance / (num_cities * (num_cities - 1) / 2.0);
+  }
+  return profile;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <asd_progetto2021/dataset/limits.hpp>
+#include <asd_progetto2021/dataset/stone_index.hpp>
+#include <asd_progetto2021/utilities/assert.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Reduced knapsack instance built from a StoneIndex.
+// Identical stones are grouped, every group is split in items of 1, 2, 4, ... copies,
+// and weights and capacity are divided by the gcd of the weights.
+struct StoneItems
+{
+  // Stones with the same weight and energy, stored in stone_ids[first, first + count)
+  struct Group
+  {
+    Stone stone;
+    int first;
+    int count;
+  };
+
+  // Bounded knapsack item: `count` copies from a group, with scaled weight
+  struct Item
+  {
+    int weight;
+    long long energy;
+    int group;
+    int count;
+  };
+
+  std::vector<int> stone_ids {};
+  std::vector<Group> groups {};
+  std::vector<Item> items {};
+  int capacity = 0;
+  int scale = 1;
+
+  auto size () const -> int
+  {
+    return items.size ();
+  }
+
+  auto operator[] (int pos) const -> Item const&
+  {
+    ASSERT (pos >= 0 && pos < size ());
+    return items[pos];
+  }
+
+  // Maps a selection of items back to stone ids.
+  // Inside a group the stones found in more cities are taken first.
+  auto expand (std::vector<int> const& selection) const -> std::vector<int>
+  {
+    auto taken = std::vector<int> (groups.size ());
+    for (auto i : selection)
+      taken[items[i].group] += items[i].count;
+
+    auto result = std::vector<int> ();
+    for (int g = 0; g < (int)groups.size (); ++g) {
+      ASSERT (taken[g] <= groups[g].count);
+      auto const first = stone_ids.begin () + groups[g].first;
+      result.insert (result.end (), first, first + taken[g]);
+    }
+    return result;
+  }
+};
+
+// Drops stones that can't be part of an optimal selection:
+// stones heavier than the capacity, stones not found in any city, and stones whose
+// dominators (lighter or equal weight, higher or equal energy) can't all fit together with them.
+// Since a dominated stone can always be swapped with a missing dominator, some optimal selection
+// avoids it. Dominance is only about weight and energy, cities are ignored.
+inline auto preprocess_stones (StoneIndex const& stones, int capacity) -> StoneItems
+{
+  ASSERT (capacity >= 0 && capacity <= MAX_GLOVE_CAPACITY);
+
+  auto result = StoneItems ();
+
+  auto candidates = std::vector<int> ();
+  for (int i = 0; i < stones.num_stones (); ++i)
+    if (stones[i].weight <= capacity && !stones.cities_with_stone (i).empty ())
+      candidates.push_back (i);
+
+  // lighter first, more energy first among equal weights, more reachable first among equals
+  std::sort (candidates.begin (), candidates.end (), [&] (int a, int b) {
+    if (stones[a] != stones[b])
+      return stones[a].weight < stones[b].weight
+        || (stones[a].weight == stones[b].weight && stones[a].energy > stones[b].energy);
+    return stones.cities_with_stone (a).size () > stones.cities_with_stone (b).size ();
+  });
+
+  // fenwick tree indexed by reversed energy, sums the weight of processed stones
+  auto dominators = std::vector<long long> (MAX_STONE_ENERGY + 2);
+  auto const add_dominator = [&] (int energy, long long weight) {
+    for (int i = MAX_STONE_ENERGY + 1 - energy; i < (int)dominators.size (); i += i & -i)
+      dominators[i] += weight;
+  };
+  auto const dominators_weight = [&] (int energy) {
+    auto sum = 0ll;
+    for (int i = MAX_STONE_ENERGY + 1 - energy; i > 0; i -= i & -i)
+      sum += dominators[i];
+    return sum;
+  };
+
+  for (int lo = 0; lo < (int)candidates.size ();) {
+    auto const stone = stones[candidates[lo]];
+    auto hi = lo;
+    while (hi < (int)candidates.size () && stones[candidates[hi]] == stone)
+      ++hi;
+
+    // every dominator is taken before any copy of this stone
+    auto const room = capacity - dominators_weight (stone.energy);
+    auto const count = room < stone.weight ? 0 : (int)std::min<long long> (hi - lo, room / stone.weight);
+    if (count > 0) {
+      result.groups.push_back ({stone, (int)result.stone_ids.size (), count});
+      result.stone_ids.insert (result.stone_ids.end (), candidates.begin () + lo, candidates.begin () + lo + count);
+    }
+
+    add_dominator (stone.energy, 1ll * stone.weight * (hi - lo));
+    lo = hi;
+  }
+
+  auto scale = 0;
+  for (auto const& group : result.groups) {
+    auto a = group.stone.weight;
+    while (a != 0) {
+      auto const r = scale % a;
+      scale = a;
+      a = r;
+    }
+  }
+  result.scale = std::max (scale, 1);
+  result.capacity = capacity / result.scale;
+
+  for (int g = 0; g < (int)result.groups.size (); ++g) {
+    auto const stone = result.groups[g].stone;
+    auto left = result.groups[g].count;
+    for (int chunk = 1; left > 0; chunk *= 2) {
+      auto const count = std::min (chunk, left);
+      result.items.push_back ({stone.weight / result.scale * count, 1ll * stone.energy * count, g, count});
+      left -= count;
+    }
+  }
+
+  return result;
+}
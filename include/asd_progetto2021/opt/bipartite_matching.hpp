@@ -1,14 +1,20 @@
 #pragma once
 #include <asd_progetto2021/opt/flow.hpp>
+#include <asd_progetto2021/utilities/thread_pool.hpp>
 
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
 
 namespace BipartiteMatching
 {
-  /*
+  // Maximum cardinality matching as a unit capacity max flow, solved by push-relabel.
   struct MaxCardinalityBipartiteMatching
   {
-    Flow::Dinic dinic;
+    Flow::PushRelabel flow;
     int size1;
 
     auto source () const -> int
@@ -42,39 +48,45 @@ namespace BipartiteMatching
     }
 
     MaxCardinalityBipartiteMatching (int size1, int size2) //
-      : dinic (size1 + size2 + 2),                         //
+      : flow (size1 + size2 + 2),                          //
         size1 (size1)
     {
       for (int i = 0; i < size1; ++i)
-        dinic.add (source (), left (i), 1);
+        flow.add (source (), left (i), 1);
       for (int i = 0; i < size2; ++i)
-        dinic.add (right (i), sink (), 1);
+        flow.add (right (i), sink (), 1);
     }
 
     auto add (int from, int to) -> void
     {
-      dinic.add (left (from), right (to), 1);
+      flow.add (left (from), right (to), 1);
     }
 
     auto solve () -> int
     {
-      return dinic.solve (source (), sink ());
+      return flow.solve (source (), sink ());
     }
 
     template<class Fn>
     auto for_each_match (Fn fn) const -> void
     {
-      dinic.for_each_flow_edge ([=] (Flow::Dinic::Edge edge) {
+      flow.for_each_flow_edge ([=] (Flow::PushRelabel::Edge edge) {
         if (edge.from != source () && edge.to != sink ())
           fn (rev_left (edge.from), rev_right (edge.to));
       });
     }
+
+    // Same as for_each_match, so it can stand in for HopcroftKarp.
+    template<class Fn>
+    auto for_each_edge (Fn fn) const -> void
+    {
+      for_each_match (fn);
+    }
   };
-*/
 
   struct WeightedMaxCardinalityBipartiteMatching
   {
-    Flow::WeightedDinic dinic;
+    Flow::CompactWeightedDinic dinic;
     int size1;
 
     auto source () const -> int
@@ -130,16 +142,484 @@ namespace BipartiteMatching
     template<class Fn>
     auto for_each_match (Fn fn) const -> void
     {
-      dinic.for_each_flow_edge ([=] (Flow::WeightedDinic::Edge edge) {
+      dinic.for_each_flow_edge ([=] (Flow::CompactWeightedDinic::Edge edge) {
         if (edge.from != source () && edge.to != sink ())
           fn (rev_left (edge.from), rev_right (edge.to));
       });
     }
   };
 
-  // Space optimized Hopcroft Karp algorithm inspired by https://codeforces.com/blog/entry/58048
-  // https://pastebin.com/q12aBwya
-  struct HopcroftKarp
+  // Matching for sparse costs, by the Hungarian method with Johnson potentials.
+  // Left vertices are inserted one at a time, in order, with a dijkstra on reduced costs over the
+  // right vertices, stopped as soon as a free right vertex is settled. A left vertex that can't be
+  // inserted stays unmatched, so the matching has maximum cardinality and minimum cost among the
+  // matchings of the left vertices inserted. When left vertices compete for the same right
+  // vertices the earlier ones stay matched, whatever the cost: it is not a min cost maximum matching.
+  struct Assignment
+  {
+    int size1;
+    int size2;
+
+    std::vector<std::pair<int, int>> edges;
+    std::vector<int> edge_costs;
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<int> costs;
+
+    std::vector<long long> potential1;
+    std::vector<long long> potential2;
+    std::vector<int> L;
+    std::vector<int> R;
+    std::vector<int> matched_cost;
+
+    std::vector<long long> distance;
+    std::vector<int> parent;
+    std::vector<int> parent_cost;
+    std::vector<int> touched;
+    std::vector<int> settled;
+    std::vector<char> is_settled;
+    Flow::RadixHeap heap;
+
+    Assignment (int size1, int size2)
+      : size1 (size1), size2 (size2),              //
+        potential1 (size1), potential2 (size2),    //
+        L (size1, -1), R (size2, -1),              //
+        matched_cost (size1),                      //
+        distance (size2, Flow::INFINITE_DISTANCE), //
+        parent (size2, -1), parent_cost (size2),   //
+        is_settled (size2, false)
+    {}
+
+    auto add (int from, int to, int cost) -> void
+    {
+      ASSERT (from >= 0 && from < size1);
+      ASSERT (to >= 0 && to < size2);
+      edges.emplace_back (from, to);
+      edge_costs.push_back (cost);
+    }
+
+    auto build () -> void
+    {
+      offsets.assign (size1 + 1, 0);
+      for (auto const& e : edges)
+        offsets[e.first + 1]++;
+      for (int i = 0; i < size1; ++i)
+        offsets[i + 1] += offsets[i];
+
+      targets.resize (edges.size ());
+      costs.resize (edges.size ());
+      auto fill = std::vector<int> (offsets.begin (), offsets.end () - 1);
+      for (std::size_t e = 0; e < edges.size (); ++e) {
+        targets[fill[edges[e].first]] = edges[e].second;
+        costs[fill[edges[e].first]++] = edge_costs[e];
+      }
+
+      // cheapest edge of each left vertex, so every reduced cost starts non negative
+      for (int i = 0; i < size1; ++i) {
+        potential1[i] = 0;
+        for (int e = offsets[i]; e < offsets[i + 1]; ++e)
+          potential1[i] = e == offsets[i] ? costs[e] : std::min<long long> (potential1[i], costs[e]);
+      }
+    }
+
+    auto reduced_cost (int from, int e) const -> long long
+    {
+      return costs[e] - potential1[from] - potential2[targets[e]];
+    }
+
+    auto relax (int from, long long base) -> void
+    {
+      for (int e = offsets[from]; e < offsets[from + 1]; ++e) {
+        auto const to = targets[e];
+        auto const d = base + reduced_cost (from, e);
+        if (!is_settled[to] && d < distance[to]) {
+          if (distance[to] == Flow::INFINITE_DISTANCE)
+            touched.push_back (to);
+          distance[to] = d;
+          parent[to] = from;
+          parent_cost[to] = costs[e];
+          heap.push (d, to);
+        }
+      }
+    }
+
+    auto augment (int root) -> bool
+    {
+      heap.clear ();
+      relax (root, 0);
+
+      auto free_vertex = -1;
+      while (!heap.empty ()) {
+        auto const top = heap.pop ();
+        auto const curr = top.second;
+        if (is_settled[curr] || (long long)top.first > distance[curr])
+          continue;
+
+        is_settled[curr] = true;
+        settled.push_back (curr);
+        if (R[curr] == -1) {
+          free_vertex = curr;
+          break;
+        }
+        relax (R[curr], distance[curr]);
+      }
+
+      if (free_vertex != -1) {
+        auto const length = distance[free_vertex];
+        potential1[root] += length;
+        for (auto j : settled) {
+          if (j == free_vertex)
+            continue;
+          potential2[j] -= length - distance[j];
+          potential1[R[j]] += length - distance[j];
+        }
+
+        for (auto j = free_vertex; j != -1;) {
+          auto const i = parent[j];
+          auto const next = L[i];
+          L[i] = j;
+          R[j] = i;
+          matched_cost[i] = parent_cost[j];
+          j = i == root ? -1 : next;
+        }
+      }
+
+      for (auto j : touched)
+        distance[j] = Flow::INFINITE_DISTANCE, parent[j] = -1, is_settled[j] = false;
+      touched.clear ();
+      settled.clear ();
+      return free_vertex != -1;
+    }
+
+    auto solve () -> std::pair<int, long long>
+    {
+      build ();
+
+      auto matched = 0;
+      for (int i = 0; i < size1; ++i)
+        if (L[i] == -1 && offsets[i] != offsets[i + 1])
+          matched += augment (i);
+
+      auto cost = 0ll;
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          cost += matched_cost[i];
+      return {matched, cost};
+    }
+
+    template<class Fn>
+    auto for_each_match (Fn fn) const -> void
+    {
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          fn (i, L[i]);
+    }
+  };
+
+  // Min cost matching of the left vertices by Bertsekas' auction with eps scaling.
+  // Left vertices bid for the right vertex of best value (benefit minus price) and raise its price
+  // by the gap to their second best value plus eps. size2 - size1 implicit dummy left vertices,
+  // with zero benefit everywhere, make the problem symmetric: a dummy always bids for the cheapest
+  // right vertex, which keeps the prices of the right vertices left free consistent.
+  // Benefits are scaled by size2 + 1, so the last phase, with eps = 1, is exact.
+  // The bids of a round are computed in parallel on the pool, if any, then applied in order.
+  // Prices survive solve: copying them into an instance with similar costs and starting from a
+  // small eps (about size2 + 1, one unit of cost) skips most of the bidding.
+  // A left vertex whose prices grow past any feasible value gives up and stays unmatched. The
+  // vertices that give up are not chosen by cost: when not every left vertex can be matched, the
+  // matching has maximum size but not always minimum cost.
+  struct Auction
+  {
+    static constexpr int ALPHA = 8;
+    static constexpr int PARALLEL_BIDDERS = 256;
+    static constexpr int DUMMY = -2;
+
+    struct Bid
+    {
+      int edge;
+      long long price;
+    };
+
+    int size1;
+    int size2;
+    ThreadPool* pool;
+
+    std::vector<std::pair<int, int>> edges;
+    std::vector<int> edge_costs;
+    std::vector<int> offsets;
+    std::vector<int> targets;
+    std::vector<int> costs;
+    std::vector<long long> benefits;
+    long long max_benefit = 0;
+
+    std::vector<long long> price;
+    std::vector<int> L;
+    std::vector<int> R;
+    std::vector<int> matched_edge;
+    std::vector<char> gave_up;
+    int free_dummies = 0;
+    long long max_price = 0;
+
+    std::vector<int> bidders;
+    std::vector<int> next_bidders;
+    std::vector<Bid> bids;
+    std::vector<int> winner;
+    std::vector<int> winner_round;
+    std::vector<std::pair<long long, int>> cheapest;
+
+    Auction (int size1, int size2, ThreadPool* pool = nullptr)
+      : size1 (size1), size2 (size2), pool (pool), //
+        price (size2), L (size1, -1), R (size2, -1),  //
+        matched_edge (size1, -1), gave_up (size1, false),  //
+        winner (size2, -1), winner_round (size2, -1)
+    {}
+
+    auto add (int from, int to, int cost) -> void
+    {
+      ASSERT (from >= 0 && from < size1);
+      ASSERT (to >= 0 && to < size2);
+      edges.emplace_back (from, to);
+      edge_costs.push_back (cost);
+    }
+
+    auto prices () const -> std::vector<long long> const&
+    {
+      return price;
+    }
+
+    auto set_prices (std::vector<long long> const& prices) -> void
+    {
+      ASSERT ((int)prices.size () == size2);
+      price = prices;
+    }
+
+    auto build () -> void
+    {
+      offsets.assign (size1 + 1, 0);
+      for (auto const& e : edges)
+        offsets[e.first + 1]++;
+      for (int i = 0; i < size1; ++i)
+        offsets[i + 1] += offsets[i];
+
+      auto max_cost = 0;
+      for (auto cost : edge_costs)
+        max_cost = std::max (max_cost, cost);
+
+      targets.resize (edges.size ());
+      costs.resize (edges.size ());
+      benefits.resize (edges.size ());
+      auto fill = std::vector<int> (offsets.begin (), offsets.end () - 1);
+      for (std::size_t e = 0; e < edges.size (); ++e) {
+        auto const pos = fill[edges[e].first]++;
+        targets[pos] = edges[e].second;
+        costs[pos] = edge_costs[e];
+        benefits[pos] = (1ll * max_cost - edge_costs[e]) * (size2 + 1);
+      }
+      max_benefit = 1ll * max_cost * (size2 + 1);
+
+      // only price differences matter, the cheapest right vertex starts at 0
+      if (size2 > 0) {
+        auto const lowest = *std::min_element (price.begin (), price.end ());
+        for (auto& p : price)
+          p -= lowest;
+      }
+    }
+
+    // Best edge of left vertex i at the current prices, with the price that keeps it eps optimal.
+    // Returns edge -1 when the vertex gives up.
+    auto bid (int i, long long eps) const -> Bid
+    {
+      auto best_edge = -1;
+      auto best = std::numeric_limits<long long>::min ();
+      auto second = std::numeric_limits<long long>::min ();
+      for (int e = offsets[i]; e < offsets[i + 1]; ++e) {
+        auto const value = benefits[e] - price[targets[e]];
+        if (value > best) {
+          second = best;
+          best = value;
+          best_edge = e;
+        } else if (value > second) {
+          second = value;
+        }
+      }
+
+      if (best_edge == -1 || price[targets[best_edge]] > max_price)
+        return {-1, 0};
+      if (second == std::numeric_limits<long long>::min ())
+        second = best - max_benefit - eps;
+      return {best_edge, price[targets[best_edge]] + best - second + eps};
+    }
+
+    auto compute_bids (long long eps) -> void
+    {
+      bids.resize (bidders.size ());
+      auto const run = [&] (int from, int to) {
+        for (int k = from; k < to; ++k)
+          bids[k] = bid (bidders[k], eps);
+      };
+
+      auto const n = (int)bidders.size ();
+      if (!pool || pool->num_threads () == 0 || n < PARALLEL_BIDDERS) {
+        run (0, n);
+        return;
+      }
+
+      auto const chunks = pool->num_threads () + 1;
+      auto tasks = std::vector<ThreadPool::TaskHandle> ();
+      for (int c = 1; c < chunks; ++c)
+        tasks.push_back (pool->spawn ([&, c] () { run (1ll * n * c / chunks, 1ll * n * (c + 1) / chunks); }));
+      run (0, n / chunks);
+      for (auto const& task : tasks)
+        pool->wait (task);
+    }
+
+    auto assign (int owner, int j, long long new_price) -> void
+    {
+      if (R[j] >= 0) {
+        L[R[j]] = -1;
+        next_bidders.push_back (R[j]);
+      } else if (R[j] == DUMMY) {
+        free_dummies++;
+      }
+
+      R[j] = owner;
+      price[j] = new_price;
+      cheapest.emplace_back (new_price, j);
+      std::push_heap (cheapest.begin (), cheapest.end (), std::greater<std::pair<long long, int>> ());
+      if ((int)cheapest.size () > 4 * size2)
+        rebuild_cheapest ();
+    }
+
+    // One entry per right vertex, drops the stale ones.
+    auto rebuild_cheapest () -> void
+    {
+      cheapest.clear ();
+      for (int j = 0; j < size2; ++j)
+        cheapest.emplace_back (price[j], j);
+      std::make_heap (cheapest.begin (), cheapest.end (), std::greater<std::pair<long long, int>> ());
+    }
+
+    // Pops stale entries, returns the cheapest right vertex or -1.
+    auto cheapest_vertex () -> int
+    {
+      auto const cmp = std::greater<std::pair<long long, int>> ();
+      while (!cheapest.empty () && cheapest.front ().first != price[cheapest.front ().second]) {
+        std::pop_heap (cheapest.begin (), cheapest.end (), cmp);
+        cheapest.pop_back ();
+      }
+      return cheapest.empty () ? -1 : cheapest.front ().second;
+    }
+
+    auto dummy_bid (long long eps) -> void
+    {
+      auto const cmp = std::greater<std::pair<long long, int>> ();
+      auto const j = cheapest_vertex ();
+      std::pop_heap (cheapest.begin (), cheapest.end (), cmp);
+      auto const top = cheapest.back ();
+      cheapest.pop_back ();
+
+      auto const next = cheapest_vertex ();
+      auto const second = next == -1 ? price[j] : price[next];
+      cheapest.push_back (top);
+      std::push_heap (cheapest.begin (), cheapest.end (), cmp);
+
+      free_dummies--;
+      assign (DUMMY, j, second + eps);
+    }
+
+    auto phase (long long eps) -> void
+    {
+      std::fill (L.begin (), L.end (), -1);
+      std::fill (R.begin (), R.end (), -1);
+      // rounds restart from 0, a winner left from an earlier phase would point past bids
+      std::fill (winner_round.begin (), winner_round.end (), -1);
+      bidders.clear ();
+      for (int i = 0; i < size1; ++i)
+        if (!gave_up[i])
+          bidders.push_back (i);
+      free_dummies = size2 - (int)bidders.size ();
+
+      rebuild_cheapest ();
+
+      // prices of a feasible problem can't grow past this within a phase
+      max_price = size2 == 0 ? 0 : *std::max_element (price.begin (), price.end ());
+      max_price += 2 * (size2 + 1ll) * (max_benefit + eps);
+
+      for (int round = 0; !bidders.empty () || free_dummies > 0; ++round) {
+        compute_bids (eps);
+
+        next_bidders.clear ();
+        for (int k = 0; k < (int)bidders.size (); ++k) {
+          if (bids[k].edge == -1) {
+            gave_up[bidders[k]] = true;
+            free_dummies++;
+            continue;
+          }
+          auto const j = targets[bids[k].edge];
+          if (winner_round[j] != round || bids[k].price > bids[winner[j]].price) {
+            winner_round[j] = round;
+            winner[j] = k;
+          }
+        }
+
+        for (int k = 0; k < (int)bidders.size (); ++k) {
+          if (bids[k].edge == -1)
+            continue;
+          auto const i = bidders[k];
+          auto const j = targets[bids[k].edge];
+          if (winner[j] != k) {
+            next_bidders.push_back (i);
+            continue;
+          }
+          assign (i, j, bids[k].price);
+          L[i] = j;
+          matched_edge[i] = bids[k].edge;
+        }
+
+        while (free_dummies > 0 && size2 > 0)
+          dummy_bid (eps);
+
+        std::swap (bidders, next_bidders);
+      }
+    }
+
+    // Starts from eps, 0 picks it from the range of the costs.
+    auto solve (long long eps = 0) -> std::pair<int, long long>
+    {
+      build ();
+      std::fill (gave_up.begin (), gave_up.end (), false);
+      for (int i = 0; i < size1; ++i)
+        gave_up[i] = offsets[i] == offsets[i + 1];
+
+      if (eps <= 0)
+        eps = std::max (1ll, max_benefit / ALPHA);
+      for (;; eps = std::max (1ll, eps / ALPHA)) {
+        phase (eps);
+        if (eps == 1)
+          break;
+      }
+
+      auto matched = 0;
+      auto cost = 0ll;
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          matched++, cost += costs[matched_edge[i]];
+      return {matched, cost};
+    }
+
+    template<class Fn>
+    auto for_each_match (Fn fn) const -> void
+    {
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          fn (i, L[i]);
+    }
+  };
+
+  // Augmenting path matching with one dfs per free vertex per round, no layering.
+  // Inspired by https://codeforces.com/blog/entry/58048, https://pastebin.com/q12aBwya
+  // Kept as a baseline for HopcroftKarp.
+  struct Kuhn
   {
     int size1;
     int size2;
@@ -149,7 +629,7 @@ namespace BipartiteMatching
     std::vector<int> R;
     std::vector<bool> visited;
 
-    HopcroftKarp (int size1, int size2)
+    Kuhn (int size1, int size2)
       : size1 (size1), size2 (size2), //
         adjacency (size1), L (size1, -1), R (size2, -1), visited (size1, false)
     {}
@@ -206,4 +686,575 @@ namespace BipartiteMatching
           fn (i, L[i]);
     }
   };
+
+  // Hopcroft Karp maximum cardinality matching, O(E sqrt V).
+  // Every phase layers the left vertices with a bfs from the free ones, then finds a maximal set
+  // of vertex disjoint shortest augmenting paths with an iterative dfs over the layered graph.
+  // Edges are collected by add and frozen in compressed rows by solve.
+  struct HopcroftKarp
+  {
+    static constexpr int UNREACHED = std::numeric_limits<int>::max ();
+
+    int size1;
+    int size2;
+
+    std::vector<std::pair<int, int>> edges;
+    std::vector<int> offsets;
+    std::vector<int> targets;
+
+    std::vector<int> L;
+    std::vector<int> R;
+    std::vector<int> level;
+    std::vector<int> next_edge;
+    std::vector<int> queue;
+    std::vector<int> stack;
+
+    // karp sipser state: right to left csr and number of free neighbours of every vertex
+    std::vector<int> reverse_offsets;
+    std::vector<int> sources;
+    std::vector<int> degree;
+    std::minstd_rand rng;
+
+    HopcroftKarp (int size1, int size2)
+      : size1 (size1), size2 (size2), //
+        L (size1, -1), R (size2, -1), level (size1), next_edge (size1), rng (size1 ^ size2)
+    {}
+
+    auto add (int from, int to) -> void
+    {
+      ASSERT (from >= 0 && from < size1);
+      ASSERT (to >= 0 && to < size2);
+      edges.emplace_back (from, to);
+    }
+
+    auto build () -> void
+    {
+      offsets.assign (size1 + 1, 0);
+      for (auto const& e : edges)
+        offsets[e.first + 1]++;
+      for (int i = 0; i < size1; ++i)
+        offsets[i + 1] += offsets[i];
+
+      targets.resize (edges.size ());
+      auto fill = std::vector<int> (offsets.begin (), offsets.end () - 1);
+      for (auto const& e : edges)
+        targets[fill[e.first]++] = e.second;
+    }
+
+    // Layers the left vertices by alternating distance from the free ones.
+    // Returns true if some free right vertex is reachable.
+    auto bfs () -> bool
+    {
+      queue.clear ();
+      for (int i = 0; i < size1; ++i) {
+        if (L[i] == -1) {
+          level[i] = 0;
+          queue.push_back (i);
+        } else {
+          level[i] = UNREACHED;
+        }
+      }
+
+      auto found = false;
+      for (std::size_t head = 0; head < queue.size (); ++head) {
+        auto const curr = queue[head];
+        for (int e = offsets[curr]; e < offsets[curr + 1]; ++e) {
+          auto const next = R[targets[e]];
+          if (next == -1) {
+            found = true;
+          } else if (level[next] == UNREACHED) {
+            level[next] = level[curr] + 1;
+            queue.push_back (next);
+          }
+        }
+      }
+      return found;
+    }
+
+    // Looks for an augmenting path from root in the layered graph and applies it.
+    // Vertices proven useless in this phase are removed by resetting their level.
+    auto augment (int root) -> bool
+    {
+      stack.clear ();
+      stack.push_back (root);
+
+      while (!stack.empty ()) {
+        auto const curr = stack.back ();
+
+        if (next_edge[curr] == offsets[curr + 1]) {
+          level[curr] = UNREACHED;
+          stack.pop_back ();
+          continue;
+        }
+
+        auto const other = targets[next_edge[curr]];
+        auto const next = R[other];
+
+        if (next == -1) {
+          for (auto vertex : stack) {
+            auto const target = targets[next_edge[vertex]];
+            L[vertex] = target;
+            R[target] = vertex;
+          }
+          return true;
+        }
+
+        if (level[next] == level[curr] + 1) {
+          stack.push_back (next);
+        } else {
+          next_edge[curr]++;
+        }
+      }
+
+      return false;
+    }
+
+    // Matches left vertex i with right vertex j, updates the free degrees of their neighbours
+    // and queues the ones left with a single free neighbour.
+    auto match (int i, int j) -> void
+    {
+      L[i] = j;
+      R[j] = i;
+      for (int e = offsets[i]; e < offsets[i + 1]; ++e) {
+        auto const other = targets[e];
+        if (R[other] == -1 && --degree[size1 + other] == 1)
+          queue.push_back (size1 + other);
+      }
+      for (int e = reverse_offsets[j]; e < reverse_offsets[j + 1]; ++e) {
+        auto const other = sources[e];
+        if (L[other] == -1 && --degree[other] == 1)
+          queue.push_back (other);
+      }
+    }
+
+    // Matches the vertices of degree one in queue, which is always safe, then what they unlock.
+    auto match_degree_one () -> void
+    {
+      while (!queue.empty ()) {
+        auto const v = queue.back ();
+        queue.pop_back ();
+
+        if (v < size1) {
+          if (L[v] != -1 || degree[v] != 1)
+            continue;
+          for (int e = offsets[v]; e < offsets[v + 1]; ++e) {
+            if (R[targets[e]] == -1) {
+              match (v, targets[e]);
+              break;
+            }
+          }
+        } else {
+          auto const j = v - size1;
+          if (R[j] != -1 || degree[v] != 1)
+            continue;
+          for (int e = reverse_offsets[j]; e < reverse_offsets[j + 1]; ++e) {
+            if (L[sources[e]] == -1) {
+              match (sources[e], j);
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    // Karp-Sipser initial matching: vertices with a single free neighbour are matched to it,
+    // when there are none a free left vertex is matched to a random free neighbour.
+    // Degrees count parallel edges, so a vertex with a repeated single neighbour is only matched greedily.
+    auto karp_sipser () -> void
+    {
+      reverse_offsets.assign (size2 + 1, 0);
+      for (int e = 0; e < (int)targets.size (); ++e)
+        reverse_offsets[targets[e] + 1]++;
+      for (int j = 0; j < size2; ++j)
+        reverse_offsets[j + 1] += reverse_offsets[j];
+
+      sources.resize (targets.size ());
+      auto fill = std::vector<int> (reverse_offsets.begin (), reverse_offsets.end () - 1);
+      for (int i = 0; i < size1; ++i)
+        for (int e = offsets[i]; e < offsets[i + 1]; ++e)
+          sources[fill[targets[e]]++] = i;
+
+      degree.resize (size1 + size2);
+      queue.clear ();
+      for (int i = 0; i < size1; ++i)
+        degree[i] = offsets[i + 1] - offsets[i];
+      for (int j = 0; j < size2; ++j)
+        degree[size1 + j] = reverse_offsets[j + 1] - reverse_offsets[j];
+      for (int v = 0; v < size1 + size2; ++v)
+        if (degree[v] == 1)
+          queue.push_back (v);
+
+      match_degree_one ();
+      for (int i = 0; i < size1; ++i) {
+        if (L[i] != -1 || degree[i] == 0)
+          continue;
+
+        auto pick = (int)(rng () % degree[i]);
+        for (int e = offsets[i]; e < offsets[i + 1]; ++e) {
+          if (R[targets[e]] == -1 && pick-- == 0) {
+            match (i, targets[e]);
+            break;
+          }
+        }
+        match_degree_one ();
+      }
+    }
+
+    // Matches every left vertex to its first free neighbour, if any. Returns the matching size.
+    auto greedy () -> int
+    {
+      auto matched = 0;
+      for (int i = 0; i < size1; ++i) {
+        for (int e = offsets[i]; e < offsets[i + 1]; ++e) {
+          if (R[targets[e]] == -1) {
+            L[i] = targets[e];
+            R[targets[e]] = i;
+            matched++;
+            break;
+          }
+        }
+      }
+      return matched;
+    }
+
+    auto solve () -> int
+    {
+      build ();
+
+      // a perfect greedy matching needs no phase, otherwise start over from karp sipser,
+      // which costs a few greedy passes but usually leaves fewer phases to run
+      if (greedy () == std::min (size1, size2))
+        return std::min (size1, size2);
+      std::fill (L.begin (), L.end (), -1);
+      std::fill (R.begin (), R.end (), -1);
+      karp_sipser ();
+
+      while (bfs ()) {
+        std::copy (offsets.begin (), offsets.end () - 1, next_edge.begin ());
+        for (int i = 0; i < size1; ++i)
+          if (L[i] == -1)
+            augment (i);
+      }
+
+      return size1 - std::count (L.begin (), L.end (), -1);
+    }
+
+    template<class Fn>
+    auto for_each_edge (Fn fn) const -> void
+    {
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          fn (i, L[i]);
+    }
+  };
+
+  // Maximum cardinality matching over adjacency bitsets, for dense graphs.
+  // Every phase grows a forest of alternating paths from all the free left vertices, expanding
+  // a left vertex with one and-not per word of its row, and augments along at most one path
+  // per tree, so the augmenting paths of a phase are vertex disjoint.
+  // A phase costs O(size1 * size2 / 64) whatever the number of edges.
+  struct BitMatching
+  {
+    int size1;
+    int size2;
+    int words;
+
+    // rows[i * words + w] holds the right vertices [64 w, 64 w + 64) adjacent to i
+    std::vector<std::uint64_t> rows;
+    std::vector<std::uint64_t> unvisited;
+
+    std::vector<int> L;
+    std::vector<int> R;
+    std::vector<int> parent;
+    std::vector<int> root;
+    std::vector<char> augmented;
+    std::vector<int> queue;
+
+    BitMatching (int size1, int size2)
+      : size1 (size1), size2 (size2), words ((size2 + 63) / 64), //
+        rows ((std::size_t)size1 * words), unvisited (words),    //
+        L (size1, -1), R (size2, -1), parent (size2), root (size1), augmented (size1)
+    {}
+
+    auto add (int from, int to) -> void
+    {
+      ASSERT (from >= 0 && from < size1);
+      ASSERT (to >= 0 && to < size2);
+      rows[(std::size_t)from * words + to / 64] |= 1ull << (to % 64);
+    }
+
+    // Marks every right vertex as not visited, unvisited doubles as the set of free right vertices
+    // in greedy.
+    auto reset_unvisited () -> void
+    {
+      std::fill (unvisited.begin (), unvisited.end (), ~0ull);
+      if (size2 % 64 != 0)
+        unvisited.back () = (1ull << (size2 % 64)) - 1;
+    }
+
+    auto row (int i) const -> std::uint64_t const*
+    {
+      return rows.data () + (std::size_t)i * words;
+    }
+
+    // Matches every left vertex to its first free neighbour, if any.
+    auto greedy () -> void
+    {
+      reset_unvisited ();
+      for (int i = 0; i < size1; ++i) {
+        auto const adjacent = row (i);
+        for (int w = 0; w < words; ++w) {
+          auto const free = adjacent[w] & unvisited[w];
+          if (free != 0) {
+            auto const j = w * 64 + __builtin_ctzll (free);
+            unvisited[w] &= ~(1ull << (j % 64));
+            L[i] = j;
+            R[j] = i;
+            break;
+          }
+        }
+      }
+    }
+
+    // Flips the path from the free right vertex j back to the root of its tree.
+    auto augment (int j) -> void
+    {
+      while (j != -1) {
+        auto const i = parent[j];
+        auto const next = L[i];
+        L[i] = j;
+        R[j] = i;
+        j = next;
+      }
+    }
+
+    // Returns true if some path was augmented.
+    auto phase () -> bool
+    {
+      reset_unvisited ();
+      queue.clear ();
+      for (int i = 0; i < size1; ++i) {
+        if (L[i] == -1) {
+          root[i] = i;
+          augmented[i] = false;
+          queue.push_back (i);
+        }
+      }
+
+      auto found = false;
+      for (std::size_t head = 0; head < queue.size (); ++head) {
+        auto const curr = queue[head];
+        auto const adjacent = row (curr);
+        for (int w = 0; w < words && !augmented[root[curr]]; ++w) {
+          auto reached = adjacent[w] & unvisited[w];
+          unvisited[w] &= ~reached;
+          for (; reached != 0; reached &= reached - 1) {
+            auto const j = w * 64 + __builtin_ctzll (reached);
+            parent[j] = curr;
+            if (R[j] == -1) {
+              augment (j);
+              augmented[root[curr]] = true;
+              found = true;
+              break;
+            }
+            root[R[j]] = root[curr];
+            queue.push_back (R[j]);
+          }
+        }
+      }
+      return found;
+    }
+
+    auto solve () -> int
+    {
+      greedy ();
+      while (phase ())
+        ;
+      return size1 - std::count (L.begin (), L.end (), -1);
+    }
+
+    template<class Fn>
+    auto for_each_edge (Fn fn) const -> void
+    {
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          fn (i, L[i]);
+    }
+  };
+
+  // Maximum cardinality matching kept up to date while left vertices come and go.
+  // Adding a vertex runs one alternating bfs from it; removing a matched vertex runs one bfs
+  // backwards from the right vertex it frees, over the right to left adjacency of the present vertices.
+  // One search is enough in both cases since the matching was maximum before the change.
+  struct IncrementalMatching
+  {
+    int size1;
+    int size2;
+
+    // reverse_adjacency[j] holds (i, k) with adjacency[i][k] == j,
+    // position[i][k] is the index of that pair in reverse_adjacency[j]
+    std::vector<std::vector<int>> adjacency;
+    std::vector<std::vector<int>> position;
+    std::vector<std::vector<std::pair<int, int>>> reverse_adjacency;
+    std::vector<char> present;
+    int num_matched = 0;
+
+    std::vector<int> L;
+    std::vector<int> R;
+    std::vector<int> parent;
+    std::vector<int> queue;
+    Flow::VisitSet visited_left;
+    Flow::VisitSet visited_right;
+
+    IncrementalMatching (int size1, int size2)
+      : size1 (size1), size2 (size2),                          //
+        adjacency (size1), position (size1),                   //
+        reverse_adjacency (size2),                             //
+        present (size1, false), L (size1, -1), R (size2, -1),  //
+        parent (std::max (size1, size2)),                      //
+        visited_left (size1), visited_right (size2)
+    {}
+
+    auto contains (int i) const -> bool
+    {
+      ASSERT (i >= 0 && i < size1);
+      return present[i];
+    }
+
+    auto is_matched (int i) const -> bool
+    {
+      ASSERT (i >= 0 && i < size1);
+      return L[i] != -1;
+    }
+
+    auto matched_right (int i) const -> int
+    {
+      ASSERT (i >= 0 && i < size1);
+      return L[i];
+    }
+
+    auto size () const -> int
+    {
+      return num_matched;
+    }
+
+    // Inserts left vertex i with neighbours [first, last), returns true if it ends up matched.
+    template<class It>
+    auto add_left (int i, It first, It last) -> bool
+    {
+      ASSERT (i >= 0 && i < size1);
+      ASSERT (!present[i]);
+
+      present[i] = true;
+      adjacency[i].assign (first, last);
+      position[i].resize (adjacency[i].size ());
+      for (int k = 0; k < (int)adjacency[i].size (); ++k) {
+        auto const j = adjacency[i][k];
+        ASSERT (j >= 0 && j < size2);
+        position[i][k] = reverse_adjacency[j].size ();
+        reverse_adjacency[j].emplace_back (i, k);
+      }
+      return augment_from_left (i);
+    }
+
+    // Removes left vertex i, returns true if the matching kept its size.
+    auto remove_left (int i) -> bool
+    {
+      ASSERT (i >= 0 && i < size1);
+      ASSERT (present[i]);
+
+      present[i] = false;
+      for (int k = 0; k < (int)adjacency[i].size (); ++k) {
+        auto& list = reverse_adjacency[adjacency[i][k]];
+        auto const moved = list.back ();
+        list[position[i][k]] = moved;
+        position[moved.first][moved.second] = position[i][k];
+        list.pop_back ();
+      }
+
+      auto const j = L[i];
+      if (j == -1)
+        return true;
+
+      L[i] = -1;
+      R[j] = -1;
+      num_matched--;
+      return augment_to_right (j);
+    }
+
+    // Alternating bfs from the free left vertex start to any free right vertex.
+    auto augment_from_left (int start) -> bool
+    {
+      visited_right.reset ();
+      queue.assign (1, start);
+      for (std::size_t head = 0; head < queue.size (); ++head) {
+        auto const curr = queue[head];
+        for (auto j : adjacency[curr]) {
+          if (visited_right.visited (j))
+            continue;
+          visited_right.visit (j);
+          parent[j] = curr;
+
+          if (R[j] != -1) {
+            queue.push_back (R[j]);
+            continue;
+          }
+
+          // every left vertex on the path moves to the right vertex it was reached from
+          for (auto to = j; to != -1;) {
+            auto const from = parent[to];
+            auto const next = L[from];
+            L[from] = to;
+            R[to] = from;
+            to = from == start ? -1 : next;
+          }
+          num_matched++;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Alternating bfs backwards from the free right vertex start to any free present left vertex.
+    auto augment_to_right (int start) -> bool
+    {
+      visited_left.reset ();
+      queue.assign (1, start);
+      for (std::size_t head = 0; head < queue.size (); ++head) {
+        auto const curr = queue[head];
+        for (auto const& entry : reverse_adjacency[curr]) {
+          auto const i = entry.first;
+          if (visited_left.visited (i))
+            continue;
+          visited_left.visit (i);
+          parent[i] = curr;
+
+          if (L[i] != -1) {
+            queue.push_back (L[i]);
+            continue;
+          }
+
+          // every left vertex on the path moves to the right vertex it was reached from
+          for (auto from = i; from != -1;) {
+            auto const to = parent[from];
+            auto const next = R[to];
+            L[from] = to;
+            R[to] = from;
+            from = to == start ? -1 : next;
+          }
+          num_matched++;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    template<class Fn>
+    auto for_each_edge (Fn fn) const -> void
+    {
+      for (int i = 0; i < size1; ++i)
+        if (L[i] != -1)
+          fn (i, L[i]);
+    }
+  };
 } // namespace BipartiteMatching
\ No newline at end of file
@@ -1,10 +1,16 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <vector>
 
 #include <asd_progetto2021/utilities/assert.hpp>
 
 namespace Flow
 {
+  constexpr auto INFINITE_DISTANCE = 1ll << 62;
+
   struct VisitSet
   {
     std::vector<int> v;
@@ -209,7 +215,75 @@ namespace Flow
     };
   */
 
-  struct WeightedDinic
+  // Monotone priority queue for non negative integer keys: keys pushed are never smaller than
+  // the last key popped. Elements sit in the bucket of the highest bit in which they differ from it.
+  struct RadixHeap
+  {
+    using key_type = unsigned long long;
+
+    std::vector<std::pair<key_type, int>> buckets[65] {};
+    key_type last = 0;
+    int count = 0;
+
+    static auto bucket (key_type x) -> int
+    {
+      return x == 0 ? 0 : 64 - __builtin_clzll (x);
+    }
+
+    auto empty () const -> bool
+    {
+      return count == 0;
+    }
+
+    auto clear () -> void
+    {
+      for (auto& b : buckets)
+        b.clear ();
+      last = 0;
+      count = 0;
+    }
+
+    auto push (key_type key, int value) -> void
+    {
+      ASSERT (key >= last);
+      buckets[bucket (key ^ last)].emplace_back (key, value);
+      ++count;
+    }
+
+    auto pop () -> std::pair<key_type, int>
+    {
+      ASSERT (!empty ());
+      if (buckets[0].empty ()) {
+        int i = 1;
+        while (buckets[i].empty ())
+          ++i;
+
+        last = buckets[i][0].first;
+        for (auto const& e : buckets[i])
+          last = std::min (last, e.first);
+        for (auto const& e : buckets[i])
+          buckets[bucket (e.first ^ last)].push_back (e);
+        buckets[i].clear ();
+      }
+
+      auto const result = buckets[0].back ();
+      buckets[0].pop_back ();
+      --count;
+      return result;
+    }
+  };
+
+  // Min cost max flow by successive shortest paths.
+  // Every phase runs dijkstra on the reduced costs given by the node potentials, updates the
+  // potentials, then pushes a blocking flow through the edges whose reduced cost is zero.
+  // Bellman-Ford only runs once, to make the initial reduced costs non negative when some cost is negative.
+  // Edges are collected by add and frozen in csr form by a counting pass and a placing pass when
+  // solve is called. Index and Capacity set the width of the endpoints and capacities of the arcs:
+  // CompactWeightedDinic packs unit capacity matchings on up to 32767 nodes in 12 bytes per arc.
+  // There is no builder from the StoneIndex edge arrays: the solutions match stones with HopcroftKarp,
+  // BitMatching or Assignment, so every graph here is built by add.
+  template<class Index, class Capacity>
+  struct BasicWeightedDinic
   {
     struct Edge
     {
@@ -218,64 +292,102 @@ namespace Flow
       int flow;
       int capacity;
       int cost;
+    };
 
-      Edge () = default;
-
-      Edge (int from, int to, int flow, int capacity, int cost) //
-        : from (from), to (to), flow (flow), capacity (capacity), cost (cost)
-      {}
-
-      auto residual () const -> int
-      {
-        return capacity - flow;
-      }
-
-      auto saturated () const -> bool
-      {
-        return residual () <= 0;
-      }
+    struct InputEdge
+    {
+      Index from;
+      Index to;
+      Capacity capacity;
+      int cost;
     };
 
-    struct Node
+    struct Arc
     {
-      std::vector<int> outgoing_edges {};
-      int level {};
-      long long distance {};
-      std::vector<int>::iterator next_edge {};
+      int reverse;
+      int cost;
+      Index to;
+      Capacity residual;
     };
 
-    std::vector<Edge> edges;
-    std::vector<Node> nodes;
+    int num_nodes;
+    std::vector<InputEdge> edges;
+    std::vector<int> edge_arc;
+
+    std::vector<int> offsets;
+    std::vector<Arc> arcs;
+
+    std::vector<int> level;
+    std::vector<int> next_arc;
+    std::vector<long long> distance;
+    std::vector<long long> potential;
 
     VisitSet visited;
     DoubleBuffer queue;
+    RadixHeap heap;
 
-    WeightedDinic (int N) //
-      : edges (),         //
-        nodes (N),        //
-        visited (N),      //
-        queue ()
-    {}
+    BasicWeightedDinic (int N) //
+      : num_nodes (N),         //
+        level (N),             //
+        next_arc (N),          //
+        distance (N),          //
+        potential (N),         //
+        visited (N),           //
+        queue (),              //
+        heap ()
+    {
+      ASSERT (N - 1 <= std::numeric_limits<Index>::max ());
+    }
+
+    auto reserve (int num_edges) -> void
+    {
+      edges.reserve (num_edges);
+    }
 
     auto add (int from, int to, int capacity, int cost) -> void
     {
-      edges.push_back ({from, to, 0, capacity, cost});
-      edges.push_back ({to, from, 0, 0, -cost});
+      ASSERT (arcs.empty ());
+      ASSERT (from >= 0 && from < num_nodes);
+      ASSERT (to >= 0 && to < num_nodes);
+      ASSERT (capacity >= 0 && capacity <= std::numeric_limits<Capacity>::max ());
+      edges.push_back ({(Index)from, (Index)to, (Capacity)capacity, cost});
+    }
+
+    auto build () -> void
+    {
+      offsets.assign (num_nodes + 1, 0);
+      for (auto const& edge : edges)
+        offsets[edge.from + 1]++, offsets[edge.to + 1]++;
+      for (int i = 0; i < num_nodes; ++i)
+        offsets[i + 1] += offsets[i];
 
-      nodes[from].outgoing_edges.push_back (edges.size () - 2);
-      nodes[to].outgoing_edges.push_back (edges.size () - 1);
+      arcs.resize (2 * edges.size ());
+      edge_arc.resize (edges.size ());
+      auto position = std::vector<int> (offsets.begin (), offsets.end () - 1);
+      for (std::size_t id = 0; id < edges.size (); ++id) {
+        auto const& edge = edges[id];
+        auto const forward = position[edge.from]++;
+        auto const backward = position[edge.to]++;
+        arcs[forward] = {backward, edge.cost, edge.to, edge.capacity};
+        arcs[backward] = {forward, -edge.cost, edge.from, 0};
+        edge_arc[id] = forward;
+      }
+    }
+
+    auto reduced_cost (int from, Arc const& arc) const -> long long
+    {
+      return arc.cost + potential[from] - potential[arc.to];
     }
 
-    auto spfa (int src, int sink) -> bool
+    // Bellman-Ford from src, sets the potentials to the distances.
+    auto spfa (int src) -> void
     {
       visited.reset ();
       queue.clear ();
-      for (auto& node : nodes)
-        node.distance = 1ull << 62;
+      std::fill (distance.begin (), distance.end (), INFINITE_DISTANCE);
 
       visited.visit (src);
-      nodes[src].level = 0;
-      nodes[src].distance = 0;
+      distance[src] = 0;
       queue.push (src);
 
       while (!queue.empty ()) {
@@ -283,70 +395,645 @@ namespace Flow
         queue.pop ();
         visited.unvisit (curr);
 
-        for (int edge_id : nodes[curr].outgoing_edges) {
-          auto const edge = edges[edge_id];
-          if (!edge.saturated () && nodes[edge.to].distance > nodes[curr].distance + edge.cost) {
-            nodes[edge.to].level = nodes[curr].level + 1;
-            nodes[edge.to].distance = nodes[curr].distance + edge.cost;
+        for (int a = offsets[curr]; a < offsets[curr + 1]; ++a) {
+          auto const& arc = arcs[a];
+          if (arc.residual > 0 && distance[arc.to] > distance[curr] + arc.cost) {
+            distance[arc.to] = distance[curr] + arc.cost;
 
-            if (visited.visited (edge.to))
+            if (visited.visited (arc.to))
               continue;
 
-            visited.visit (edge.to);
-            queue.push (edge.to);
+            visited.visit (arc.to);
+            queue.push (arc.to);
           }
         }
       }
 
-      return nodes[sink].distance != (1ull << 62);
+      for (int i = 0; i < num_nodes; ++i)
+        potential[i] = distance[i] == INFINITE_DISTANCE ? 0 : distance[i];
     }
 
-    auto augment (int edge_id, int bottleneck) -> void
+    // Dijkstra on the reduced costs, stops once the sink is settled.
+    // Potentials grow by min(distance, distance of the sink), which keeps reduced costs non negative.
+    auto dijkstra (int src, int sink) -> bool
     {
-      edges[edge_id].flow += bottleneck;
-      edges[edge_id ^ 1].flow -= bottleneck;
+      heap.clear ();
+      std::fill (distance.begin (), distance.end (), INFINITE_DISTANCE);
+
+      distance[src] = 0;
+      heap.push (0, src);
+
+      while (!heap.empty ()) {
+        auto const top = heap.pop ();
+        auto const curr = top.second;
+        if ((long long)top.first > distance[curr])
+          continue;
+        if (curr == sink)
+          break;
+
+        for (int a = offsets[curr]; a < offsets[curr + 1]; ++a) {
+          auto const& arc = arcs[a];
+          if (arc.residual <= 0)
+            continue;
+
+          auto const d = distance[curr] + reduced_cost (curr, arc);
+          if (d < distance[arc.to]) {
+            distance[arc.to] = d;
+            heap.push (d, arc.to);
+          }
+        }
+      }
+
+      auto const sink_distance = distance[sink];
+      if (sink_distance == INFINITE_DISTANCE)
+        return false;
+
+      for (int i = 0; i < num_nodes; ++i)
+        potential[i] += std::min (distance[i], sink_distance);
+      return true;
     }
 
-    auto dfs (int curr, int sink, int bottleneck, long long dist) -> int
+    // Levels of the subgraph of residual arcs with zero reduced cost.
+    auto bfs (int src, int sink) -> bool
+    {
+      visited.reset ();
+      queue.clear ();
+
+      visited.visit (src);
+      level[src] = 0;
+      queue.push (src);
+
+      while (!queue.empty ()) {
+        auto const curr = queue.back ();
+        queue.pop ();
+        for (int a = offsets[curr]; a < offsets[curr + 1]; ++a) {
+          auto const& arc = arcs[a];
+          if (arc.residual > 0 && reduced_cost (curr, arc) == 0 && !visited.visited (arc.to)) {
+            visited.visit (arc.to);
+            level[arc.to] = level[curr] + 1;
+            queue.push (arc.to);
+          }
+        }
+      }
+      return visited.visited (sink);
+    }
+
+    auto augment (int a, int bottleneck) -> void
+    {
+      arcs[a].residual -= bottleneck;
+      arcs[arcs[a].reverse].residual += bottleneck;
+    }
+
+    auto dfs (int curr, int sink, int bottleneck) -> int
     {
       if (curr == sink)
         return bottleneck;
 
-      while (nodes[curr].next_edge != nodes[curr].outgoing_edges.end ()) {
-        auto const edge_id = *nodes[curr].next_edge;
-        auto const edge = edges[edge_id];
-        if (!edge.saturated () && nodes[edge.to].level == nodes[curr].level + 1) {
-          if (dist + edge.cost <= nodes[edge.to].distance) {
-            auto const pushed = dfs (edge.to, sink, std::min (bottleneck, edge.residual ()), dist + edge.cost);
-            if (pushed > 0) {
-              augment (edge_id, pushed);
-              return pushed;
-            }
+      for (; next_arc[curr] < offsets[curr + 1]; next_arc[curr]++) {
+        auto const a = next_arc[curr];
+        auto const& arc = arcs[a];
+        if (arc.residual > 0 && level[arc.to] == level[curr] + 1 && reduced_cost (curr, arc) == 0) {
+          auto const pushed = dfs (arc.to, sink, std::min<int> (bottleneck, arc.residual));
+          if (pushed > 0) {
+            augment (a, pushed);
+            return pushed;
           }
         }
-        nodes[curr].next_edge++;
       }
       return 0;
     }
 
     auto solve (int src, int sink) -> std::pair<int, long long>
     {
+      build ();
+
+      auto const negative = std::any_of (edges.begin (), edges.end (), [] (InputEdge const& e) { //
+        return e.capacity > 0 && e.cost < 0;
+      });
+      if (negative)
+        spfa (src);
+
       auto flow = 0;
       auto cost = 0ll;
-      while (spfa (src, sink)) {
-        for (auto& node : nodes)
-          node.next_edge = node.outgoing_edges.begin ();
+      while (dijkstra (src, sink)) {
+        if (!bfs (src, sink))
+          break;
 
-        auto pushed = dfs (src, sink, 1u << 30, 0ll);
+        std::copy (offsets.begin (), offsets.end () - 1, next_arc.begin ());
+
+        // every admissible path costs the potential difference between sink and source
+        auto const path_cost = potential[sink] - potential[src];
+        auto pushed = dfs (src, sink, 1u << 30);
         while (pushed > 0) {
           flow += pushed;
-          cost += 1ll * pushed * nodes[sink].distance;
-          pushed = dfs (src, sink, 1u << 30, 0ll);
+          cost += 1ll * pushed * path_cost;
+          pushed = dfs (src, sink, 1u << 30);
         }
       }
       return {flow, cost};
     }
 
+    template<class Fn>
+    auto for_each_flow_edge (Fn fn) const -> void
+    {
+      for (std::size_t id = 0; id < edges.size (); ++id) {
+        auto const& e = edges[id];
+        auto const flow = e.capacity - arcs[edge_arc[id]].residual;
+        if (flow > 0)
+          fn (Edge {e.from, e.to, flow, e.capacity, e.cost});
+      }
+    }
+  };
+
+  using WeightedDinic = BasicWeightedDinic<int, int>;
+  using CompactWeightedDinic = BasicWeightedDinic<std::int16_t, std::int8_t>;
+
+  // Min cost max flow by cost scaling push-relabel (Goldberg-Tarjan).
+  // A return edge from sink to src with a cost lower than any path turns the problem into a min cost
+  // circulation. Costs are multiplied by the number of nodes plus one, so an eps-optimal circulation
+  // with eps = 1 is optimal, since a cycle has at most num_nodes arcs. Every refine phase divides eps
+  // by ALPHA and restores eps-optimality with FIFO push-relabel. The residual graph is built in csr
+  // form when solve is called.
+  struct CostScaling
+  {
+    static constexpr int ALPHA = 16;
+
+    struct Edge
+    {
+      int from;
+      int to;
+      int flow;
+      int capacity;
+      int cost;
+    };
+
+    std::vector<Edge> edges;
+    int num_nodes;
+
+    // residual arcs, grouped by tail node
+    std::vector<int> offsets;
+    std::vector<int> arc_to;
+    std::vector<int> arc_residual;
+    std::vector<long long> arc_cost;
+    std::vector<int> arc_reverse;
+    std::vector<int> edge_arc;
+
+    std::vector<long long> excess;
+    std::vector<long long> price;
+    std::vector<int> current_arc;
+    std::vector<int> queue;
+    std::vector<char> is_queued;
+    int queue_head = 0;
+    int queue_size = 0;
+
+    CostScaling (int N) : edges (), num_nodes (N)
+    {}
+
+    auto add (int from, int to, int capacity, int cost) -> void
+    {
+      ASSERT (from >= 0 && from < num_nodes);
+      ASSERT (to >= 0 && to < num_nodes);
+      ASSERT (capacity >= 0);
+      edges.push_back ({from, to, 0, capacity, cost});
+    }
+
+    auto build (int src, int sink, int return_capacity, long long return_cost) -> void
+    {
+      auto const num_arcs = 2 * ((int)edges.size () + 1);
+      offsets.assign (num_nodes + 1, 0);
+      for (auto const& edge : edges)
+        offsets[edge.from + 1]++, offsets[edge.to + 1]++;
+      offsets[sink + 1]++, offsets[src + 1]++;
+      for (int i = 0; i < num_nodes; ++i)
+        offsets[i + 1] += offsets[i];
+
+      arc_to.resize (num_arcs);
+      arc_residual.resize (num_arcs);
+      arc_cost.resize (num_arcs);
+      arc_reverse.resize (num_arcs);
+      edge_arc.resize (edges.size () + 1);
+
+      auto position = std::vector<int> (offsets.begin (), offsets.end () - 1);
+      auto const add_arcs = [&] (int id, int from, int to, int capacity, long long cost) {
+        auto const forward = position[from]++;
+        auto const backward = position[to]++;
+        arc_to[forward] = to, arc_residual[forward] = capacity, arc_cost[forward] = cost;
+        arc_to[backward] = from, arc_residual[backward] = 0, arc_cost[backward] = -cost;
+        arc_reverse[forward] = backward, arc_reverse[backward] = forward;
+        edge_arc[id] = forward;
+      };
+
+      for (int id = 0; id < (int)edges.size (); ++id) {
+        auto const& edge = edges[id];
+        add_arcs (id, edge.from, edge.to, edge.capacity, edge.cost * cost_scale ());
+      }
+      add_arcs (edges.size (), sink, src, return_capacity, return_cost * cost_scale ());
+    }
+
+    auto cost_scale () const -> long long
+    {
+      return num_nodes + 1ll;
+    }
+
+    auto reduced_cost (int from, int arc) const -> long long
+    {
+      return arc_cost[arc] + price[from] - price[arc_to[arc]];
+    }
+
+    auto push (int from, int arc, long long amount) -> void
+    {
+      auto const to = arc_to[arc];
+      arc_residual[arc] -= amount;
+      arc_residual[arc_reverse[arc]] += amount;
+      excess[from] -= amount;
+      excess[to] += amount;
+    }
+
+    auto enqueue (int node) -> void
+    {
+      if (is_queued[node] || excess[node] <= 0)
+        return;
+      is_queued[node] = true;
+      queue[(queue_head + queue_size++) % num_nodes] = node;
+    }
+
+    // Lowers the price of node so that its cheapest residual arc gets reduced cost -eps.
+    auto relabel (int node, long long eps) -> void
+    {
+      auto best = -INFINITE_DISTANCE;
+      for (int arc = offsets[node]; arc < offsets[node + 1]; ++arc)
+        if (arc_residual[arc] > 0)
+          best = std::max (best, price[arc_to[arc]] - arc_cost[arc]);
+
+      ASSERT (best != -INFINITE_DISTANCE);
+      price[node] = best - eps;
+    }
+
+    auto discharge (int node, long long eps) -> void
+    {
+      while (excess[node] > 0) {
+        if (current_arc[node] == offsets[node + 1]) {
+          relabel (node, eps);
+          current_arc[node] = offsets[node];
+        }
+
+        auto const arc = current_arc[node];
+        if (arc_residual[arc] > 0 && reduced_cost (node, arc) < 0) {
+          push (node, arc, std::min<long long> (excess[node], arc_residual[arc]));
+          enqueue (arc_to[arc]);
+          if (arc_residual[arc] > 0)
+            continue;
+        }
+        current_arc[node]++;
+      }
+    }
+
+    // Turns an eps * ALPHA optimal circulation into an eps optimal one.
+    auto refine (long long eps) -> void
+    {
+      for (int node = 0; node < num_nodes; ++node)
+        for (int arc = offsets[node]; arc < offsets[node + 1]; ++arc)
+          if (arc_residual[arc] > 0 && reduced_cost (node, arc) < 0)
+            push (node, arc, arc_residual[arc]);
+
+      // every node is queued at most once, so the queue is a ring of num_nodes slots
+      queue.resize (num_nodes);
+      is_queued.assign (num_nodes, false);
+      queue_head = queue_size = 0;
+      for (int node = 0; node < num_nodes; ++node) {
+        current_arc[node] = offsets[node];
+        enqueue (node);
+      }
+
+      while (queue_size > 0) {
+        auto const node = queue[queue_head];
+        queue_head = (queue_head + 1) % num_nodes;
+        queue_size--;
+        is_queued[node] = false;
+        discharge (node, eps);
+      }
+    }
+
+    auto solve (int src, int sink) -> std::pair<int, long long>
+    {
+      ASSERT (src != sink);
+
+      auto max_cost = 1ll;
+      auto return_capacity = 0ll;
+      for (auto const& edge : edges) {
+        max_cost = std::max<long long> (max_cost, std::abs (edge.cost));
+        if (edge.from == src)
+          return_capacity += edge.capacity;
+      }
+      return_capacity = std::min<long long> (return_capacity, 1 << 30);
+
+      // any path from src to sink is cheaper than num_nodes * max_cost
+      auto const return_cost = -(num_nodes * max_cost + 1);
+      ASSERT ((double)-return_cost * cost_scale () < 1e17);
+
+      build (src, sink, return_capacity, return_cost);
+      excess.assign (num_nodes, 0);
+      price.assign (num_nodes, 0);
+      current_arc.assign (num_nodes, 0);
+
+      auto eps = -return_cost * cost_scale ();
+      do {
+        eps = std::max (1ll, eps / ALPHA);
+        refine (eps);
+      } while (eps > 1);
+
+      auto cost = 0ll;
+      for (int id = 0; id < (int)edges.size (); ++id) {
+        auto& edge = edges[id];
+        edge.flow = edge.capacity - arc_residual[edge_arc[id]];
+        cost += 1ll * edge.flow * edge.cost;
+      }
+      auto const flow = return_capacity - arc_residual[edge_arc[edges.size ()]];
+      return {(int)flow, cost};
+    }
+
+    template<class Fn>
+    auto for_each_flow_edge (Fn fn) const -> void
+    {
+      for (auto e : edges)
+        if (e.flow > 0)
+          fn (e);
+    }
+  };
+
+  // Maximum flow by push-relabel, always discharging an active node of highest label.
+  // When a label below num_nodes empties, every node above it is cut off from the sink and is lifted
+  // to num_nodes + 1 (gap heuristic). Every num_nodes relabels the labels are recomputed exactly by a
+  // backwards bfs from the sink, then from the source for the nodes that can only send their excess back.
+  // The first phase only discharges nodes labelled below num_nodes, which gives the flow value; the
+  // second one sends the remaining excess back to the source, so the flow on the edges is valid.
+  // The residual graph is built in csr form when solve is called.
+  struct PushRelabel
+  {
+    struct Edge
+    {
+      int from;
+      int to;
+      int flow;
+      int capacity;
+    };
+
+    std::vector<Edge> edges;
+    int num_nodes;
+
+    // residual arcs, grouped by tail node
+    std::vector<int> offsets;
+    std::vector<int> arc_to;
+    std::vector<int> arc_residual;
+    std::vector<int> arc_reverse;
+    std::vector<int> edge_arc;
+
+    std::vector<long long> excess;
+    std::vector<int> height;
+    std::vector<int> current_arc;
+    std::vector<int> queue;
+    int src = 0;
+    int sink = 0;
+    int relabels = 0;
+    int max_active_height = 0;
+
+    // active nodes by label, stale entries are skipped when popped
+    std::vector<std::vector<int>> active;
+    int highest_active = -1;
+
+    // doubly linked lists of the nodes with label below num_nodes, by label
+    std::vector<int> first_at;
+    std::vector<int> next_at;
+    std::vector<int> prev_at;
+    int highest_listed = -1;
+
+    PushRelabel (int N) : edges (), num_nodes (N)
+    {}
+
+    auto add (int from, int to, int capacity) -> void
+    {
+      ASSERT (from >= 0 && from < num_nodes);
+      ASSERT (to >= 0 && to < num_nodes);
+      ASSERT (capacity >= 0);
+      edges.push_back ({from, to, 0, capacity});
+    }
+
+    auto build () -> void
+    {
+      offsets.assign (num_nodes + 1, 0);
+      for (auto const& edge : edges)
+        offsets[edge.from + 1]++, offsets[edge.to + 1]++;
+      for (int i = 0; i < num_nodes; ++i)
+        offsets[i + 1] += offsets[i];
+
+      arc_to.resize (2 * edges.size ());
+      arc_residual.resize (2 * edges.size ());
+      arc_reverse.resize (2 * edges.size ());
+      edge_arc.resize (edges.size ());
+
+      auto position = std::vector<int> (offsets.begin (), offsets.end () - 1);
+      for (int id = 0; id < (int)edges.size (); ++id) {
+        auto const& edge = edges[id];
+        auto const forward = position[edge.from]++;
+        auto const backward = position[edge.to]++;
+        arc_to[forward] = edge.to, arc_residual[forward] = edge.capacity;
+        arc_to[backward] = edge.from, arc_residual[backward] = 0;
+        arc_reverse[forward] = backward, arc_reverse[backward] = forward;
+        edge_arc[id] = forward;
+      }
+    }
+
+    auto activate (int node) -> void
+    {
+      if (node == src || node == sink || height[node] >= max_active_height)
+        return;
+      active[height[node]].push_back (node);
+      highest_active = std::max (highest_active, height[node]);
+    }
+
+    auto link (int node) -> void
+    {
+      auto const h = height[node];
+      if (h >= num_nodes)
+        return;
+      prev_at[node] = -1;
+      next_at[node] = first_at[h];
+      if (first_at[h] != -1)
+        prev_at[first_at[h]] = node;
+      first_at[h] = node;
+      highest_listed = std::max (highest_listed, h);
+    }
+
+    auto unlink (int node) -> void
+    {
+      auto const h = height[node];
+      if (h >= num_nodes)
+        return;
+      if (prev_at[node] != -1)
+        next_at[prev_at[node]] = next_at[node];
+      else
+        first_at[h] = next_at[node];
+      if (next_at[node] != -1)
+        prev_at[next_at[node]] = prev_at[node];
+    }
+
+    auto push (int from, int arc, int amount) -> void
+    {
+      auto const to = arc_to[arc];
+      arc_residual[arc] -= amount;
+      arc_residual[arc_reverse[arc]] += amount;
+      excess[from] -= amount;
+      excess[to] += amount;
+      if (excess[to] == amount)
+        activate (to);
+    }
+
+    // Backwards bfs over the residual arcs from root, labelling the nodes still unlabelled.
+    auto label_from (int root, int base) -> void
+    {
+      queue.assign (1, root);
+      height[root] = base;
+      for (std::size_t head = 0; head < queue.size (); ++head) {
+        auto const curr = queue[head];
+        for (int arc = offsets[curr]; arc < offsets[curr + 1]; ++arc) {
+          auto const next = arc_to[arc];
+          if (height[next] == 2 * num_nodes && arc_residual[arc_reverse[arc]] > 0) {
+            height[next] = height[curr] + 1;
+            queue.push_back (next);
+          }
+        }
+      }
+    }
+
+    auto global_relabel () -> void
+    {
+      // the source keeps label num_nodes
+      height.assign (num_nodes, 2 * num_nodes);
+      height[src] = num_nodes;
+      label_from (sink, 0);
+      label_from (src, num_nodes);
+
+      first_at.assign (num_nodes, -1);
+      highest_listed = -1;
+      for (auto& bucket : active)
+        bucket.clear ();
+      highest_active = -1;
+
+      for (int node = 0; node < num_nodes; ++node) {
+        current_arc[node] = offsets[node];
+        link (node);
+        if (excess[node] > 0)
+          activate (node);
+      }
+      relabels = 0;
+    }
+
+    // Lifts every node with a label in (h, num_nodes) to num_nodes + 1.
+    auto gap (int h) -> void
+    {
+      for (int k = h + 1; k <= highest_listed; ++k) {
+        for (int node = first_at[k]; node != -1; node = next_at[node]) {
+          height[node] = num_nodes + 1;
+          current_arc[node] = offsets[node];
+          if (excess[node] > 0)
+            activate (node);
+        }
+        first_at[k] = -1;
+      }
+      highest_listed = h - 1;
+    }
+
+    auto relabel (int node) -> void
+    {
+      ++relabels;
+      auto lowest = 2 * num_nodes;
+      for (int arc = offsets[node]; arc < offsets[node + 1]; ++arc)
+        if (arc_residual[arc] > 0)
+          lowest = std::min (lowest, height[arc_to[arc]]);
+
+      auto const old = height[node];
+      unlink (node);
+      height[node] = std::min (lowest + 1, 2 * num_nodes);
+      current_arc[node] = offsets[node];
+
+      if (old < num_nodes && first_at[old] == -1) {
+        gap (old);
+        height[node] = std::max (height[node], num_nodes + 1);
+      } else {
+        link (node);
+      }
+    }
+
+    auto discharge (int node) -> void
+    {
+      while (excess[node] > 0) {
+        if (current_arc[node] == offsets[node + 1]) {
+          relabel (node);
+          if (height[node] >= max_active_height)
+            break;
+          continue;
+        }
+
+        auto const arc = current_arc[node];
+        if (arc_residual[arc] > 0 && height[node] == height[arc_to[arc]] + 1) {
+          push (node, arc, (int)std::min<long long> (excess[node], arc_residual[arc]));
+          if (excess[node] == 0)
+            break;
+        }
+        current_arc[node]++;
+      }
+    }
+
+    // Discharges the active nodes labelled below max_active_height.
+    auto run () -> void
+    {
+      global_relabel ();
+      while (highest_active >= 0) {
+        auto& bucket = active[highest_active];
+        if (bucket.empty ()) {
+          highest_active--;
+          continue;
+        }
+
+        auto const node = bucket.back ();
+        bucket.pop_back ();
+        if (height[node] != highest_active || excess[node] == 0)
+          continue;
+
+        discharge (node);
+        if (relabels > num_nodes)
+          global_relabel ();
+      }
+    }
+
+    auto solve (int src, int sink) -> int
+    {
+      ASSERT (src != sink);
+      this->src = src;
+      this->sink = sink;
+
+      build ();
+      excess.assign (num_nodes, 0);
+      current_arc.assign (num_nodes, 0);
+      next_at.assign (num_nodes, -1);
+      prev_at.assign (num_nodes, -1);
+      active.assign (2 * num_nodes + 1, {});
+
+      height.assign (num_nodes, 0);
+      max_active_height = num_nodes;
+      for (int arc = offsets[src]; arc < offsets[src + 1]; ++arc)
+        if (arc_residual[arc] > 0)
+          push (src, arc, arc_residual[arc]);
+
+      run ();
+      max_active_height = 2 * num_nodes;
+      run ();
+
+      for (int id = 0; id < (int)edges.size (); ++id)
+        edges[id].flow = edges[id].capacity - arc_residual[edge_arc[id]];
+      return excess[sink];
+    }
+
     template<class Fn>
     auto for_each_flow_edge (Fn fn) const -> void
     {
@@ -1,12 +1,26 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <limits>
 #include <numeric>
 #include <vector>
 
 #include <asd_progetto2021/utilities/assert.hpp>
+#include <asd_progetto2021/utilities/thread_pool.hpp>
 
 namespace Knapsack
 {
+  // Above this many dp updates knapsack falls back to the fptas.
+  constexpr auto MAX_DP_CELLS = 2000000000ll;
+
+  // Rough dp throughput, to turn a time budget into a number of dp updates.
+  constexpr auto DP_CELLS_PER_MS = 500000ll;
+
+  // Up to this many items knapsack may enumerate subsets instead of running the dp.
+  constexpr auto MAX_MEET_IN_THE_MIDDLE_ITEMS = 40;
+
   struct KnapsackSolution
   {
     std::vector<int> selection;
@@ -19,6 +33,56 @@ namespace Knapsack
     {}
   };
 
+  // Memory reused across knapsack_hirschberg calls.
+  // The dp rows of a recursion level are released before recursing, so the arena
+  // never holds more than one pair of rows no matter how deep the recursion goes.
+  struct KnapsackWorkspace
+  {
+    std::vector<long long> arena {};
+    std::size_t used = 0;
+
+    std::vector<int> selection {};
+    int weight = 0;
+    long long value = 0;
+
+    KnapsackWorkspace () = default;
+
+    KnapsackWorkspace (int capacity, int num_items)
+    {
+      reserve (capacity, num_items);
+    }
+
+    auto reserve (int capacity, int num_items) -> void
+    {
+      ASSERT (used == 0);
+      if (arena.size () < 2 * (capacity + 1ull))
+        arena.resize (2 * (capacity + 1ull));
+      selection.reserve (num_items);
+    }
+
+    auto clear () -> void
+    {
+      used = 0;
+      selection.clear ();
+      weight = 0;
+      value = 0;
+    }
+
+    auto allocate (int size) -> long long*
+    {
+      ASSERT (used + size <= arena.size ());
+      auto const result = arena.data () + used;
+      used += size;
+      return result;
+    }
+
+    auto release (long long* from) -> void
+    {
+      ASSERT (from >= arena.data () && from <= arena.data () + used);
+      used = from - arena.data ();
+    }
+  };
+
   template<class WeightFn, class ValueFn, class It>
   inline auto knapsack_forward_dp (int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn, long long* out) -> void
   {
@@ -47,43 +111,406 @@ namespace Knapsack
     knapsack_forward_dp (capacity, reverse_first, reverse_last, weight_fn, value_fn, out);
   }
 
+  // Returns the capacity assigned to the first half that maximizes the combined value.
+  inline auto knapsack_split_point (int capacity, long long const* dp1, long long const* dp2) -> int
+  {
+    auto best_value = std::numeric_limits<long long>::min ();
+    auto best_weight = -1;
+    for (int w = 0; w <= capacity; ++w) {
+      if (dp1[w] + dp2[capacity - w] > best_value) {
+        best_value = dp1[w] + dp2[capacity - w];
+        best_weight = w;
+      }
+    }
+    return best_weight;
+  }
+
   template<class WeightFn, class ValueFn, class It>
-  inline auto knapsack_hirschberg (int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn) -> KnapsackSolution
+  inline auto knapsack_hirschberg_append (KnapsackWorkspace& workspace,
+    int capacity,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn) -> void
   {
     // can't take anything
     if (last == first || capacity == 0)
-      return KnapsackSolution {std::vector<int> (), 0, 0ll, true};
+      return;
 
     // only one choice
     if (last - first == 1) {
       if (weight_fn (*first) <= capacity && value_fn (*first) > 0) {
-        return {std::vector<int> ({*first}), weight_fn (*first), 0ll + value_fn (*first), true};
-      } else {
-        return {std::vector<int> (), 0, 0ll, true};
+        workspace.selection.push_back (*first);
+        workspace.weight += weight_fn (*first);
+        workspace.value += value_fn (*first);
       }
+      return;
     }
 
     auto const mid = first + (last - first) / 2;
 
-    auto dp1 = std::vector<long long> (capacity + 1);
-    auto dp2 = std::vector<long long> (capacity + 1);
-    knapsack_forward_dp (capacity, first, mid, weight_fn, value_fn, dp1.data ());
-    knapsack_backward_dp (capacity, mid, last, weight_fn, value_fn, dp2.data ());
+    auto const dp1 = workspace.allocate (capacity + 1);
+    auto const dp2 = workspace.allocate (capacity + 1);
+    knapsack_forward_dp (capacity, first, mid, weight_fn, value_fn, dp1);
+    knapsack_backward_dp (capacity, mid, last, weight_fn, value_fn, dp2);
 
-    auto best_value = std::numeric_limits<long long>::min ();
-    auto best_weight = -1;
-    for (int w = 0; w <= capacity; ++w) {
-      if (dp1[w] + dp2[capacity - w] > best_value) {
-        best_value = dp1[w] + dp2[capacity - w];
-        best_weight = w;
+    auto const best_weight = knapsack_split_point (capacity, dp1, dp2);
+
+    workspace.release (dp1);
+
+    knapsack_hirschberg_append (workspace, best_weight, first, mid, weight_fn, value_fn);
+    knapsack_hirschberg_append (workspace, capacity - best_weight, mid, last, weight_fn, value_fn);
+  }
+
+  // Solves into workspace.selection, workspace.weight and workspace.value.
+  // Does not allocate once the workspace has been used for a problem at least as large.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_hirschberg (KnapsackWorkspace& workspace,
+    int capacity,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn) -> void
+  {
+    workspace.clear ();
+    workspace.reserve (capacity, last - first);
+    knapsack_hirschberg_append (workspace, capacity, first, last, weight_fn, value_fn);
+  }
+
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_hirschberg (int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn) -> KnapsackSolution
+  {
+    auto workspace = KnapsackWorkspace ();
+    knapsack_hirschberg (workspace, capacity, first, last, weight_fn, value_fn);
+    return KnapsackSolution {std::move (workspace.selection), workspace.weight, workspace.value, true};
+  }
+
+  // Min weight needed to reach at least each value in [0, total_value].
+  // Values above total_value are clipped to it.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_min_weight_dp (long long total_value,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn,
+    long long* out) -> void
+  {
+    ASSERT (total_value >= 0);
+
+    std::fill (out, out + total_value + 1, std::numeric_limits<long long>::max () / 2);
+    out[0] = 0;
+
+    for (auto it = first; it != last; ++it) {
+      auto const weight = 0ll + weight_fn (*it);
+      auto const value = value_fn (*it);
+      if (value == 0)
+        continue;
+      for (auto v = total_value; v >= 0; v--) {
+        auto const to = std::min<long long> (total_value, v + value);
+        if (out[to] > out[v] + weight)
+          out[to] = out[v] + weight;
+      }
+    }
+
+    for (auto v = total_value; v > 0; v--)
+      if (out[v - 1] > out[v])
+        out[v - 1] = out[v];
+  }
+
+  // Hirschberg recursion on the min weight dp. Maximizes the sum of value_fn, which must be
+  // non negative integers, and appends the chosen items to selection.
+  // max_value is an upper bound on the optimum, the dp tables never grow past it.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_min_weight_append (std::vector<int>& selection,
+    long long capacity,
+    long long max_value,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn) -> void
+  {
+    if (last == first)
+      return;
+
+    if (last - first == 1) {
+      if (weight_fn (*first) <= capacity)
+        selection.push_back (*first);
+      return;
+    }
+
+    auto const mid = first + (last - first) / 2;
+
+    auto total1 = 0ll;
+    auto total2 = 0ll;
+    for (auto it = first; it != mid; ++it)
+      total1 += value_fn (*it);
+    for (auto it = mid; it != last; ++it)
+      total2 += value_fn (*it);
+    total1 = std::min (total1, max_value);
+    total2 = std::min (total2, max_value);
+
+    auto dp1 = std::vector<long long> (total1 + 1);
+    auto dp2 = std::vector<long long> (total2 + 1);
+    knapsack_min_weight_dp (total1, first, mid, weight_fn, value_fn, dp1.data ());
+    knapsack_min_weight_dp (total2, mid, last, weight_fn, value_fn, dp2.data ());
+
+    // both tables are non decreasing, the best partner of v1 only moves down
+    auto best_value = -1ll;
+    auto best_weight = 0ll;
+    auto v2 = total2;
+    for (auto v1 = 0ll; v1 <= total1 && dp1[v1] <= capacity; ++v1) {
+      while (dp2[v2] > capacity - dp1[v1])
+        v2--;
+      if (v1 + v2 > best_value) {
+        best_value = v1 + v2;
+        best_weight = dp1[v1];
       }
     }
 
     dp1 = {};
     dp2 = {};
 
-    KnapsackSolution lhs = knapsack_hirschberg (best_weight, first, mid, weight_fn, value_fn);
-    KnapsackSolution rhs = knapsack_hirschberg (capacity - best_weight, mid, last, weight_fn, value_fn);
+    knapsack_min_weight_append (selection, best_weight, max_value, first, mid, weight_fn, value_fn);
+    knapsack_min_weight_append (selection, capacity - best_weight, max_value, mid, last, weight_fn, value_fn);
+  }
+
+  // Greedy by value density, or the best single item if better. At least half of the optimum.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_lower_bound (int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn) -> long long
+  {
+    auto indices = std::vector<int> (first, last);
+    std::sort (indices.begin (), indices.end (), [&] (int a, int b) {
+      return 1.0 * value_fn (a) / weight_fn (a) > 1.0 * value_fn (b) / weight_fn (b);
+    });
+
+    auto best_single = 0ll;
+    auto greedy = 0ll;
+    auto weight = 0ll;
+    for (auto i : indices) {
+      if (weight_fn (i) > capacity)
+        continue;
+      best_single = std::max (best_single, 0ll + value_fn (i));
+      if (weight + weight_fn (i) <= capacity)
+        weight += weight_fn (i), greedy += value_fn (i);
+    }
+    return std::max (best_single, greedy);
+  }
+
+  // Profits are divided by floor(epsilon * lower_bound / n) and the scaled problem is solved exactly,
+  // so the value found is at least (1 - epsilon) times the optimum.
+  // The result is exact when the scale factor is 1.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_fptas (double epsilon, int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn)
+    -> KnapsackSolution
+  {
+    ASSERT (epsilon > 0.0);
+
+    auto items = std::vector<int> ();
+    for (auto it = first; it != last; ++it)
+      if (weight_fn (*it) <= capacity && value_fn (*it) > 0)
+        items.push_back (*it);
+
+    if (items.empty () || capacity == 0)
+      return KnapsackSolution {std::vector<int> (), 0, 0ll, true};
+
+    auto const lower_bound = knapsack_lower_bound (capacity, items.begin (), items.end (), weight_fn, value_fn);
+    auto const scale = std::max (1ll, (long long)(epsilon * lower_bound / items.size ()));
+    auto const scaled_fn = [&] (int id) -> long long { return value_fn (id) / scale; };
+
+    // the optimum is at most twice the lower bound
+    auto selection = std::vector<int> ();
+    auto const max_value = 2 * lower_bound / scale + 1;
+    knapsack_min_weight_append (selection, capacity, max_value, items.begin (), items.end (), weight_fn, scaled_fn);
+
+    auto weight = 0;
+    auto value = 0ll;
+    for (auto i : selection)
+      weight += weight_fn (i), value += value_fn (i);
+    return KnapsackSolution {std::move (selection), weight, value, scale == 1};
+  }
+
+  // Smallest epsilon for which knapsack_fptas does about max_cells dp updates.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto fptas_epsilon (long long max_cells, int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn)
+    -> double
+  {
+    ASSERT (max_cells > 0);
+
+    auto num_items = 0ll;
+    auto total_value = 0ll;
+    for (auto it = first; it != last; ++it) {
+      if (weight_fn (*it) <= capacity && value_fn (*it) > 0) {
+        num_items++;
+        total_value += value_fn (*it);
+      }
+    }
+
+    auto const lower_bound = knapsack_lower_bound (capacity, first, last, weight_fn, value_fn);
+    if (num_items == 0 || lower_bound == 0)
+      return 1.0;
+
+    // the recursion costs about twice the top level dp, which has num_items rows
+    // of min(total_value, 2 * lower_bound) / scale cells
+    auto const row = std::min (total_value, 2 * lower_bound);
+    auto const scale = std::max (1ll, (2 * num_items * row + max_cells - 1) / max_cells);
+    return (scale + 0.5) * num_items / lower_bound;
+  }
+
+  struct SubsetSum
+  {
+    long long weight;
+    long long value;
+    std::uint32_t mask;
+  };
+
+  // All subsets of [first, last) that are not dominated by a lighter or equal subset,
+  // sorted by increasing weight and so by increasing value.
+  // Every item merges the current frontier with a shifted copy of itself, then prunes it.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_pareto_subsets (It first, It last, WeightFn weight_fn, ValueFn value_fn) -> std::vector<SubsetSum>
+  {
+    ASSERT (last - first <= 31);
+
+    auto const lighter = [] (SubsetSum const& a, SubsetSum const& b) {
+      return a.weight < b.weight || (a.weight == b.weight && a.value > b.value);
+    };
+
+    auto result = std::vector<SubsetSum> ({{0ll, 0ll, 0u}});
+    auto shifted = std::vector<SubsetSum> ();
+    auto merged = std::vector<SubsetSum> ();
+
+    auto bit = 0;
+    for (auto it = first; it != last; ++it, ++bit) {
+      auto const weight = 0ll + weight_fn (*it);
+      auto const value = 0ll + value_fn (*it);
+
+      shifted.clear ();
+      for (auto const& subset : result)
+        shifted.push_back ({subset.weight + weight, subset.value + value, subset.mask | (1u << bit)});
+
+      merged.clear ();
+      std::merge (result.begin (), result.end (), shifted.begin (), shifted.end (), std::back_inserter (merged), lighter);
+
+      result.clear ();
+      for (auto const& subset : merged)
+        if (result.empty () || subset.value > result.back ().value)
+          result.push_back (subset);
+    }
+
+    return result;
+  }
+
+  // Exact solver for few items: enumerates the subsets of each half, keeps the pareto
+  // frontier of each and matches them with two pointers. Independent of the capacity.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_meet_in_the_middle (int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn)
+    -> KnapsackSolution
+  {
+    ASSERT (last - first <= MAX_MEET_IN_THE_MIDDLE_ITEMS);
+
+    auto const mid = first + (last - first) / 2;
+    auto const lhs = knapsack_pareto_subsets (first, mid, weight_fn, value_fn);
+    auto const rhs = knapsack_pareto_subsets (mid, last, weight_fn, value_fn);
+
+    // the empty subset is always rhs[0]
+    auto best = SubsetSum {0ll, -1ll, 0u};
+    auto best_rhs = 0;
+    auto j = (int)rhs.size () - 1;
+    for (auto const& a : lhs) {
+      if (a.weight > capacity)
+        break;
+      while (rhs[j].weight > capacity - a.weight)
+        j--;
+      if (a.value + rhs[j].value > best.value) {
+        best = {a.weight + rhs[j].weight, a.value + rhs[j].value, a.mask};
+        best_rhs = j;
+      }
+    }
+
+    auto selection = std::vector<int> ();
+    for (auto it = first; it != mid; ++it)
+      if ((best.mask >> (it - first)) & 1)
+        selection.push_back (*it);
+    for (auto it = mid; it != last; ++it)
+      if ((rhs[best_rhs].mask >> (it - mid)) & 1)
+        selection.push_back (*it);
+    return KnapsackSolution {std::move (selection), (int)best.weight, best.value, true};
+  }
+
+  // Workspaces of knapsack_hirschberg_parallel, a stack for every thread of the pool.
+  // A thread waiting for a task runs other subproblems meanwhile, so a subproblem takes the next
+  // workspace of its thread and gives it back before returning. Only one thread outside the pool
+  // may use it at a time, they all share index 0.
+  struct ParallelKnapsackWorkspace
+  {
+    std::vector<std::deque<KnapsackWorkspace>> stacks;
+    std::vector<int> depth;
+
+    explicit ParallelKnapsackWorkspace (ThreadPool const& pool) //
+      : stacks (pool.num_threads () + 1),                        //
+        depth (pool.num_threads () + 1, 0)
+    {}
+
+    auto acquire (int thread) -> KnapsackWorkspace&
+    {
+      if (depth[thread] == (int)stacks[thread].size ())
+        stacks[thread].emplace_back ();
+      return stacks[thread][depth[thread]++];
+    }
+
+    auto release (int thread) -> void
+    {
+      ASSERT (depth[thread] > 0);
+      stacks[thread][--depth[thread]].clear ();
+    }
+  };
+
+  // Same result as knapsack_hirschberg. The two half dps and the two recursive calls run as
+  // separate tasks on the pool while the subproblem has at least `cutoff` dp cells.
+  // The dp rows and the smaller subproblems are solved in the workspaces of the thread running
+  // them, which don't allocate once they have been used for a problem at least as large.
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack_hirschberg_parallel (ThreadPool& pool,
+    ParallelKnapsackWorkspace& workspaces,
+    int capacity,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn,
+    long long cutoff = 1ll << 20) -> KnapsackSolution
+  {
+    auto const thread = pool.thread_index ();
+
+    if (last - first <= 1 || capacity == 0 || 1ll * (capacity + 1) * (last - first) < cutoff) {
+      auto& workspace = workspaces.acquire (thread);
+      knapsack_hirschberg (workspace, capacity, first, last, weight_fn, value_fn);
+      auto result = KnapsackSolution {workspace.selection, workspace.weight, workspace.value, true};
+      workspaces.release (thread);
+      return result;
+    }
+
+    auto const mid = first + (last - first) / 2;
+
+    auto& workspace = workspaces.acquire (thread);
+    workspace.reserve (capacity, 0);
+    auto const dp1 = workspace.allocate (capacity + 1);
+    auto const dp2 = workspace.allocate (capacity + 1);
+    auto backward = pool.spawn ([&] () { //
+      knapsack_backward_dp (capacity, mid, last, weight_fn, value_fn, dp2);
+    });
+    knapsack_forward_dp (capacity, first, mid, weight_fn, value_fn, dp1);
+    pool.wait (backward);
+
+    auto const best_weight = knapsack_split_point (capacity, dp1, dp2);
+    workspaces.release (thread);
+
+    auto rhs = KnapsackSolution {std::vector<int> (), 0, 0ll, true};
+    auto right = pool.spawn ([&] () {
+      rhs = knapsack_hirschberg_parallel (
+        pool, workspaces, capacity - best_weight, mid, last, weight_fn, value_fn, cutoff);
+    });
+    auto lhs = knapsack_hirschberg_parallel (pool, workspaces, best_weight, first, mid, weight_fn, value_fn, cutoff);
+    pool.wait (right);
 
     lhs.value += rhs.value;
     lhs.weight += rhs.weight;
@@ -92,7 +519,25 @@ namespace Knapsack
   }
 
   template<class WeightFn, class ValueFn, class It>
-  inline auto knapsack (int capacity, It first, It last, WeightFn weight_fn, ValueFn value_fn) -> KnapsackSolution
+  inline auto knapsack_hirschberg_parallel (ThreadPool& pool,
+    int capacity,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn,
+    long long cutoff = 1ll << 20) -> KnapsackSolution
+  {
+    auto workspaces = ParallelKnapsackWorkspace (pool);
+    return knapsack_hirschberg_parallel (pool, workspaces, capacity, first, last, weight_fn, value_fn, cutoff);
+  }
+
+  template<class WeightFn, class ValueFn, class It>
+  inline auto knapsack (int capacity,
+    It first,
+    It last,
+    WeightFn weight_fn,
+    ValueFn value_fn,
+    long long max_cells = MAX_DP_CELLS) -> KnapsackSolution
   {
     // can't take anything
     if (first == last || capacity == 0) {
@@ -165,11 +610,16 @@ namespace Knapsack
       return KnapsackSolution {std::move (result), curr_weight, curr_value, true};
     }
 
-    // crash if too much space
-    ASSERT (capacity <= 1000000000);
+    // few items, enumerating up to 2^(n/2) subsets per side is cheaper than capacity cells per item
+    auto const num_items = last - first;
+    if (num_items <= MAX_MEET_IN_THE_MIDDLE_ITEMS && (1ll << ((num_items + 1) / 2)) * 8 < num_items * (capacity + 1ll))
+      return knapsack_meet_in_the_middle (capacity, first, last, weight_fn, value_fn);
 
-    // crash if too much time
-    ASSERT (1ll * capacity * (last - first) <= 2000000000);
+    // exact dp too expensive, approximate
+    if (1ll * (capacity + 1) * (last - first) > max_cells) {
+      auto const epsilon = fptas_epsilon (max_cells, capacity, first, last, weight_fn, value_fn);
+      return knapsack_fptas (epsilon, capacity, first, last, weight_fn, value_fn);
+    }
 
     // general solution
     return knapsack_hirschberg (capacity, first, last, weight_fn, value_fn);
@@ -0,0 +1,242 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <asd_progetto2021/opt/knapsack.hpp>
+#include <asd_progetto2021/utilities/assert.hpp>
+
+namespace Knapsack
+{
+  // Best value for every capacity up to a fixed maximum, over a fixed list of items.
+  // The forward dp row is kept every `stride` items, so a query that excludes some items
+  // redoes the dp only from the last checkpoint before the first excluded item, and only
+  // up to the queried capacity. The checkpoints hold at most max_cells values, the stride grows
+  // to fit them. Rebuilding a selection keeps stride * (capacity + 1) bits.
+  struct KnapsackFrontier
+  {
+  private:
+    std::vector<int> _items {};
+    std::vector<int> _weights {};
+    std::vector<long long> _values {};
+    std::vector<int> _position {};
+    int _capacity = 0;
+    int _stride = 1;
+
+    // _checkpoints[k] is the dp over the items in [0, k * stride)
+    std::vector<std::vector<long long>> _checkpoints {};
+    std::vector<long long> _frontier {};
+
+    // query scratch space
+    std::vector<char> _excluded {};
+    std::vector<std::vector<long long>> _boundaries {};
+    std::vector<std::vector<long long>> _group {};
+    std::vector<long long> _row {};
+    std::vector<std::uint64_t> _taken {};
+
+    auto mark (std::vector<int> const& excluded) -> int
+    {
+      auto first_excluded = size ();
+      for (auto id : excluded) {
+        if (id < 0 || id >= (int)_position.size () || _position[id] == -1)
+          continue;
+        _excluded[_position[id]] = true;
+        first_excluded = std::min (first_excluded, _position[id]);
+      }
+      return first_excluded;
+    }
+
+    auto unmark (std::vector<int> const& excluded) -> void
+    {
+      for (auto id : excluded)
+        if (id >= 0 && id < (int)_position.size () && _position[id] != -1)
+          _excluded[_position[id]] = false;
+    }
+
+    // Runs the dp over the items in [from, to) that are not excluded.
+    // When record is set, the improving decisions are stored in _taken.
+    auto sweep (int capacity, int from, int to, long long* row, bool record) -> void
+    {
+      auto const width = capacity + 1ll;
+      if (record)
+        _taken.assign (((to - from) * width + 63) / 64, 0);
+
+      for (int pos = from; pos < to; ++pos) {
+        if (_excluded[pos])
+          continue;
+
+        auto const weight = _weights[pos];
+        auto const value = _values[pos];
+        auto const offset = (pos - from) * width;
+        for (int w = capacity; w >= weight; w--) {
+          if (row[w] < row[w - weight] + value) {
+            row[w] = row[w - weight] + value;
+            if (record)
+              _taken[(offset + w) / 64] |= 1ull << ((offset + w) % 64);
+          }
+        }
+      }
+    }
+
+    // Walks back the decisions of the last recorded sweep, returns the capacity left for the prefix.
+    auto backtrack (int capacity, int from, int to, std::vector<int>& selection) const -> int
+    {
+      auto const width = capacity + 1ll;
+      auto w = capacity;
+      for (int pos = to - 1; pos >= from; --pos) {
+        auto const bit = (pos - from) * width + w;
+        if (!_excluded[pos] && (_taken[bit / 64] >> (bit % 64)) & 1) {
+          selection.push_back (_items[pos]);
+          w -= _weights[pos];
+        }
+      }
+      return w;
+    }
+
+  public:
+    template<class WeightFn, class ValueFn, class It>
+    KnapsackFrontier (int capacity,
+      It first,
+      It last,
+      WeightFn weight_fn,
+      ValueFn value_fn,
+      long long max_cells = 1ll << 20)
+      : _capacity (capacity)
+    {
+      ASSERT (capacity >= 0);
+
+      auto max_id = -1;
+      for (auto it = first; it != last; ++it) {
+        _items.push_back (*it);
+        _weights.push_back (weight_fn (*it));
+        _values.push_back (value_fn (*it));
+        max_id = std::max (max_id, (int)*it);
+      }
+
+      _position.assign (max_id + 1, -1);
+      for (int pos = 0; pos < size (); ++pos)
+        _position[_items[pos]] = pos;
+      _excluded.assign (size (), false);
+
+      auto const rows = std::max (1ll, std::min<long long> (size (), max_cells / (capacity + 1ll)));
+      _stride = std::max (1ll, (size () + rows - 1) / rows);
+
+      _frontier.assign (capacity + 1, 0ll);
+      for (int pos = 0; pos < size (); ++pos) {
+        if (pos % _stride == 0)
+          _checkpoints.push_back (_frontier);
+        sweep (capacity, pos, pos + 1, _frontier.data (), false);
+      }
+      if (_checkpoints.empty ())
+        _checkpoints.push_back (_frontier);
+    }
+
+    auto size () const -> int
+    {
+      return _items.size ();
+    }
+
+    auto capacity () const -> int
+    {
+      return _capacity;
+    }
+
+    // Best value for each capacity in [0, capacity ()], same as knapsack_forward_dp.
+    auto frontier () const -> std::vector<long long> const&
+    {
+      return _frontier;
+    }
+
+    auto value (int capacity) const -> long long
+    {
+      ASSERT (capacity >= 0 && capacity <= _capacity);
+      return _frontier[capacity];
+    }
+
+    // Best value for capacity without the excluded items.
+    auto value (int capacity, std::vector<int> const& excluded) -> long long
+    {
+      ASSERT (capacity >= 0 && capacity <= _capacity);
+
+      auto const first_excluded = mark (excluded);
+      if (first_excluded == size ()) {
+        unmark (excluded);
+        return _frontier[capacity];
+      }
+
+      auto const segment = first_excluded / _stride;
+      _boundaries.resize (1);
+      _boundaries[0].assign (_checkpoints[segment].begin (), _checkpoints[segment].begin () + capacity + 1);
+      sweep (capacity, segment * _stride, size (), _boundaries[0].data (), false);
+
+      unmark (excluded);
+      return _boundaries[0][capacity];
+    }
+
+    // Best selection for capacity without the excluded items.
+    // The rows after the first excluded item are kept every `group` segments, about the square
+    // root of their number, and the rows of a group are redone from its first one when it is walked
+    // back: two rows per group instead of one per segment, for one more sweep.
+    auto solve (int capacity, std::vector<int> const& excluded) -> KnapsackSolution
+    {
+      ASSERT (capacity >= 0 && capacity <= _capacity);
+
+      auto const first_excluded = mark (excluded);
+      auto const num_segments = ((int)size () + _stride - 1) / _stride;
+      auto const first_segment = std::min (first_excluded / _stride, num_segments);
+      auto const num_changed = num_segments - first_segment;
+      auto group = 1;
+      while (group * group < num_changed)
+        ++group;
+
+      // _boundaries[g] is the row at the start of segment first_segment + g * group
+      _boundaries.resize ((num_changed + group - 1) / group);
+      if (num_changed > 0) {
+        _row.assign (_checkpoints[first_segment].begin (), _checkpoints[first_segment].begin () + capacity + 1);
+        for (int s = first_segment; s < num_segments; ++s) {
+          if ((s - first_segment) % group == 0)
+            _boundaries[(s - first_segment) / group].assign (_row.begin (), _row.end ());
+          sweep (capacity, s * _stride, std::min (size (), (s + 1) * _stride), _row.data (), false);
+        }
+      }
+
+      auto selection = std::vector<int> ();
+      auto w = capacity;
+      for (int s = num_segments - 1; s >= 0; --s) {
+        auto const from = s * _stride;
+        auto const to = std::min (size (), from + _stride);
+
+        // the rows of a group are only needed up to the capacity left when it is reached
+        if (s >= first_segment && (s == num_segments - 1 || (s + 1 - first_segment) % group == 0)) {
+          auto const g = (s - first_segment) / group;
+          auto const group_first = first_segment + g * group;
+          _group.resize (s - group_first + 1);
+          _group[0].assign (_boundaries[g].begin (), _boundaries[g].begin () + w + 1);
+          for (int k = 1; k < (int)_group.size (); ++k) {
+            _group[k].assign (_group[k - 1].begin (), _group[k - 1].end ());
+            auto const segment = group_first + k - 1;
+            sweep (w, segment * _stride, (segment + 1) * _stride, _group[k].data (), false);
+          }
+        }
+
+        if (s >= first_segment) {
+          auto const& start = _group[(s - first_segment) % group];
+          _row.assign (start.begin (), start.begin () + w + 1);
+        } else {
+          _row.assign (_checkpoints[s].begin (), _checkpoints[s].begin () + w + 1);
+        }
+        sweep (w, from, to, _row.data (), true);
+        w = backtrack (w, from, to, selection);
+      }
+
+      unmark (excluded);
+
+      std::reverse (selection.begin (), selection.end ());
+      auto weight = 0;
+      auto value = 0ll;
+      for (auto id : selection)
+        weight += _weights[_position[id]], value += _values[_position[id]];
+      return KnapsackSolution {std::move (selection), weight, value, true};
+    }
+  };
+} // namespace Knapsack
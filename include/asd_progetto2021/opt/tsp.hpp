@@ -5,11 +5,14 @@
 #include <vector>
 
 #include <asd_progetto2021/utilities/assert.hpp>
+#include <asd_progetto2021/utilities/deadline.hpp>
+#include <asd_progetto2021/utilities/random.hpp>
+#include <asd_progetto2021/utilities/trace.hpp>
 
 namespace Tsp
 {
-  template<class DistFn>
-  inline auto tsp_bootstrap_greedy (int* const first, int n, DistFn dist_fn, std::mt19937& rng) -> int
+  template<class DistFn, class Rng>
+  inline auto tsp_bootstrap_greedy (int* const first, int n, DistFn dist_fn, Rng& rng) -> int
   {
     auto indices = std::vector<int> (n);
     std::iota (indices.begin (), indices.end (), 0);
@@ -33,8 +36,8 @@ namespace Tsp
     return cost;
   }
 
-  template<class DistFn>
-  inline auto tsp_bootstrap_greedy (int* const first, int n, DistFn dist_fn, int rounds, std::mt19937& rng) -> int
+  template<class DistFn, class Rng>
+  inline auto tsp_bootstrap_greedy (int* const first, int n, DistFn dist_fn, int rounds, Rng& rng) -> int
   {
     auto result = std::vector<int> (first, first + n);
     auto best = tsp_bootstrap_greedy (result.data (), n, dist_fn, rng);
@@ -126,14 +129,14 @@ namespace Tsp
     return 0;
   }
 
-  template<class DistFn>
-  inline auto tsp_improve_random3 (int* first, int n, DistFn dist_fn, std::mt19937& rng) -> int
+  template<class DistFn, class Rng>
+  inline auto tsp_improve_random3 (int* first, int n, DistFn dist_fn, Rng& rng) -> int
   {
     auto improved = 0;
     for (int i = 0; i < 10; ++i) {
-      int x = rng () % n;
-      int y = rng () % n;
-      int z = rng () % n;
+      int x = random_below (rng, n);
+      int y = random_below (rng, n);
+      int z = random_below (rng, n);
 
       if (y < x)
         std::swap (x, y);
@@ -147,13 +150,13 @@ namespace Tsp
     return improved;
   }
 
-  template<class DistFn>
-  inline auto tsp_improve_random2 (int* first, int n, DistFn dist_fn, std::mt19937& rng) -> int
+  template<class DistFn, class Rng>
+  inline auto tsp_improve_random2 (int* first, int n, DistFn dist_fn, Rng& rng) -> int
   {
     auto improved = 0;
     for (int i = 0; i < 10; ++i) {
-      int x = rng () % n;
-      int y = rng () % n;
+      int x = random_below (rng, n);
+      int y = random_below (rng, n);
 
       if (y < x)
         std::swap (x, y);
@@ -162,29 +165,56 @@ namespace Tsp
     return improved;
   }
 
-  template<class DistFn>
-  inline auto tsp (int* first, int n, int start, DistFn dist_fn, std::mt19937& rng, double allowed_ms = 1000) -> int
+  // Calls publish (first, n) now and then with the tour found so far, not yet rotated to start,
+  // when it improved since the last call.
+  template<class DistFn, class Rng, class PublishFn>
+  inline auto tsp (int* first, int n, int start, DistFn dist_fn, Rng& rng, double allowed_ms, PublishFn publish) -> int
   {
-    auto const time_start = std::clock ();
-    auto const time_elapsed = [time_start] () -> double {
-      auto now = std::clock ();
-      return std::difftime (now, time_start) * 1000.0 / CLOCKS_PER_SEC;
-    };
+    auto deadline = Deadline (allowed_ms * 0.3);
 
-    auto first_cost = tsp_bootstrap_greedy (first, n, dist_fn, 8, rng);
+    auto first_cost = [&] () {
+      TRACE_SPAN ("tsp_bootstrap_greedy");
+      return tsp_bootstrap_greedy (first, n, dist_fn, 8, rng);
+    }();
+    publish (first, n);
 
     int cost = 0;
-    while (time_elapsed () < allowed_ms * 0.3)
-      cost += tsp_improve_random3 (first, n, dist_fn, rng);
+    auto rounds = 0;
+    auto published_cost = 0;
+    auto const improve = [&] (int improved) {
+      cost += improved;
+      if (++rounds % 1024 == 0 && cost < published_cost) {
+        publish (first, n);
+        published_cost = cost;
+      }
+    };
+
+    {
+      TRACE_SPAN ("tsp_opt3");
+      while (!deadline.expired ())
+        improve (tsp_improve_random3 (first, n, dist_fn, rng));
+    }
 
     if (cost < -50) {
-      while (time_elapsed () < allowed_ms * 0.90)
-        cost += tsp_improve_random3 (first, n, dist_fn, rng);
-      while (time_elapsed () < allowed_ms)
-        cost += tsp_improve_random2 (first, n, dist_fn, rng);
+      {
+        TRACE_SPAN ("tsp_opt3_continued");
+        deadline.set_budget (allowed_ms * 0.9);
+        while (!deadline.expired ())
+          improve (tsp_improve_random3 (first, n, dist_fn, rng));
+      }
+      TRACE_SPAN ("tsp_opt2");
+      deadline.set_budget (allowed_ms);
+      while (!deadline.expired ())
+        improve (tsp_improve_random2 (first, n, dist_fn, rng));
     }
 
     std::rotate (first, std::find (first, first + n, start), first + n);
     return cost + first_cost;
   }
+
+  template<class DistFn, class Rng>
+  inline auto tsp (int* first, int n, int start, DistFn dist_fn, Rng& rng, double allowed_ms = 1000) -> int
+  {
+    return tsp (first, n, start, dist_fn, rng, allowed_ms, [] (int const*, int) {});
+  }
 } // namespace Tsp
\ No newline at end of file
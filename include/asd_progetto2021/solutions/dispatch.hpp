@@ -0,0 +1,82 @@
+#pragma once
+#include <asd_progetto2021/dataset/anytime_output.hpp>
+#include <asd_progetto2021/solutions/general.hpp>
+#include <asd_progetto2021/solutions/no_tour.hpp>
+#include <asd_progetto2021/solutions/selection_only.hpp>
+#include <asd_progetto2021/solutions/single_matching.hpp>
+#include <asd_progetto2021/solutions/tsp_only.hpp>
+
+#include <utility>
+
+enum class SolverKind
+{
+  selection_only,
+  tsp_only,
+  no_tour,
+  single_matching,
+  general
+};
+
+// The most specialized solver that fits the dataset.
+inline auto choose_solver (Dataset const& dataset) -> SolverKind
+{
+  auto const& profile = dataset.profile ();
+  auto const tour_does_not_matter = dataset.glove_resistance () == 0.0 || profile.constant_distance;
+  auto const stones_dont_matter = dataset.glove_capacity () == 0 || profile.reachable_stones == 0;
+  auto const only_one_matching = profile.max_stone_degree <= 1;
+
+  if (tour_does_not_matter && only_one_matching)
+    return SolverKind::selection_only;
+  if (stones_dont_matter)
+    return SolverKind::tsp_only;
+  if (tour_does_not_matter)
+    return SolverKind::no_tour;
+  if (only_one_matching)
+    return SolverKind::single_matching;
+  return SolverKind::general;
+}
+
+inline auto solver_name (SolverKind kind) -> char const*
+{
+  switch (kind) {
+    case SolverKind::selection_only:
+      return "selection_only";
+    case SolverKind::tsp_only:
+      return "tsp_only";
+    case SolverKind::no_tour:
+      return "no_tour";
+    case SolverKind::single_matching:
+      return "single_matching";
+    case SolverKind::general:
+      return "general";
+  }
+  return "";
+}
+
+// Runs the solver of the given kind, publishing to output the solvers that support it.
+template<class Rng>
+inline auto solve_with (SolverKind kind, Dataset const& dataset, Rng& rng, double allowed_ms, AnytimeOutput* output = nullptr)
+  -> std::pair<SimpleRoute, StoneMatching>
+{
+  switch (kind) {
+    case SolverKind::selection_only: {
+      // every stone has a single city and the tour does not matter
+      auto matching = StoneMatching (dataset);
+      for (auto i : solve_selection_only (dataset, rng))
+        matching.match (i, dataset.cities_with_stone (i).at (0));
+      return {SimpleRoute (dataset), std::move (matching)};
+    }
+    case SolverKind::tsp_only:
+      // find a good tour
+      return {solve_tsp_only (dataset, rng, allowed_ms, output), StoneMatching (dataset)};
+    case SolverKind::no_tour:
+      // find a complete matching and selection
+      return {SimpleRoute (dataset), solve_no_tour (dataset, rng, allowed_ms)};
+    case SolverKind::single_matching:
+      // find a good selection and tour
+      return solve_single_matching (dataset, rng, allowed_ms, output);
+    case SolverKind::general:
+      break;
+  }
+  return solve_general (dataset, rng, allowed_ms, output);
+}
@@ -1,10 +1,15 @@
 #pragma once
+#include <asd_progetto2021/dataset/anytime_output.hpp>
 #include <asd_progetto2021/dataset/evaluation.hpp>
+#include <asd_progetto2021/dataset/stone_items.hpp>
 #include <asd_progetto2021/dataset/stone_matching.hpp>
 #include <asd_progetto2021/dataset/tour.hpp>
 #include <asd_progetto2021/opt/bipartite_matching.hpp>
 #include <asd_progetto2021/opt/knapsack.hpp>
+#include <asd_progetto2021/utilities/random.hpp>
+#include <asd_progetto2021/utilities/telemetry.hpp>
 #include <asd_progetto2021/utilities/timer.hpp>
+#include <asd_progetto2021/utilities/trace.hpp>
 
 #include <cmath>
 #include <iostream>
@@ -12,19 +17,42 @@
 #include <numeric>
 #include <random>
 
-inline auto select_knapsack (Dataset const& dataset) -> std::vector<int>
+// Falls back to the knapsack fptas when the exact dp would take more than allowed_ms.
+inline auto select_knapsack (Dataset const& dataset, double allowed_ms) -> std::vector<int>
 {
-  auto indices = std::vector<int> (dataset.num_stones ());
+  TRACE_SPAN ("select_knapsack");
+  auto const items = preprocess_stones (dataset.stones (), dataset.glove_capacity ());
+  auto indices = std::vector<int> (items.size ());
   std::iota (indices.begin (), indices.end (), 0);
 
-  auto const weight_fn = [&] (int id) -> int { return dataset.stone (id).weight; };
-  auto const value_fn = [&] (int id) -> long long { return dataset.stone (id).energy; };
+  auto const weight_fn = [&] (int id) -> int { return items[id].weight; };
+  auto const value_fn = [&] (int id) -> long long { return items[id].energy; };
 
-  return Knapsack::knapsack (dataset.glove_capacity (), indices.begin (), indices.end (), weight_fn, value_fn).selection;
+  auto const max_cells = std::max (1ll, (long long)(allowed_ms * Knapsack::DP_CELLS_PER_MS));
+  auto const result = Knapsack::knapsack (items.capacity, indices.begin (), indices.end (), weight_fn, value_fn, max_cells);
+  return items.expand (result.selection);
+}
+
+template<class Matcher>
+inline auto match_stones (Dataset const& dataset, std::vector<int> const& selection) -> std::vector<std::pair<int, int>>
+{
+  auto bip = Matcher (selection.size (), dataset.num_cities ());
+  for (int i = 0; i < (int)selection.size (); ++i)
+    for (auto j : dataset.cities_with_stone (selection[i]))
+      bip.add (i, j);
+
+  auto const matched = bip.solve ();
+  (void)matched;
+  ASSERT (matched == (int)selection.size ());
+
+  auto result = std::vector<std::pair<int, int>> ();
+  bip.for_each_edge ([&] (int from, int to) { result.emplace_back (selection[from], to); });
+  return result;
 }
 
 inline auto find_matching (Dataset const& dataset, std::vector<int> selection) -> std::vector<std::pair<int, int>>
 {
+  TRACE_SPAN ("find_matching");
   std::sort (selection.begin (), selection.end (), [&] (int a, int b) {
     return dataset.stone (a).energy > dataset.stone (b).energy;
   });
@@ -32,23 +60,22 @@ inline auto find_matching (Dataset const& dataset, std::vector<int> selection) -
   if (selection.size () > dataset.num_cities ())
     selection.resize (dataset.num_cities ());
 
-  auto bip = BipartiteMatching::HopcroftKarp (selection.size (), dataset.num_cities ());
-
-  for (int i = 0; i < (int)selection.size (); ++i)
-    for (auto j : dataset.cities_with_stone (selection[i]))
-      bip.add (i, j);
-
-  auto matched = bip.solve ();
-  auto result = std::vector<std::pair<int, int>> ();
-
-  ASSERT (matched == selection.size ());
-
-  bip.for_each_edge ([&] (int from, int to) { result.emplace_back (selection[from], to); });
-  return result;
+  // a bitset phase costs a word per 64 cities for every stone, an adjacency list phase an
+  // operation per edge: the bitsets win once stones are found on average in 1/128 of the cities
+  auto edges = 0ll;
+  for (auto i : selection)
+    edges += dataset.cities_with_stone (i).size ();
+  if (edges * 128 >= (long long)selection.size () * dataset.num_cities ())
+    return match_stones<BipartiteMatching::BitMatching> (dataset, selection);
+  return match_stones<BipartiteMatching::HopcroftKarp> (dataset, selection);
 }
 
+// Matches the stones late in the tour by weight. The stones are inserted by decreasing energy, so
+// when stones compete for the same cities the more energetic ones are kept, at the cheapest cost
+// for the stones kept.
 inline auto find_matching_heavy (SimpleRoute const& tour, std::vector<int> selection) -> std::vector<std::pair<int, int>>
 {
+  TRACE_SPAN ("find_matching_heavy");
   auto const& dataset = tour.dataset ();
 
   std::sort (selection.begin (), selection.end (), [&] (int a, int b) {
@@ -58,10 +85,10 @@ inline auto find_matching_heavy (SimpleRoute const& tour, std::vector<int> selec
   if (selection.size () > dataset.num_cities ())
     selection.resize (dataset.num_cities ());
 
-  auto bip = BipartiteMatching::WeightedMaxCardinalityBipartiteMatching (dataset.num_stones (), dataset.num_cities ());
-  for (auto i : selection)
-    for (auto j : dataset.cities_with_stone (i)) {
-      auto w = dataset.stone (i).weight;
+  auto bip = BipartiteMatching::Assignment (selection.size (), dataset.num_cities ());
+  for (int i = 0; i < (int)selection.size (); ++i)
+    for (auto j : dataset.cities_with_stone (selection[i])) {
+      auto w = dataset.stone (selection[i]).weight;
       auto c = tour.city_index (j);
       auto k = dataset.num_cities () - c + 1;
       bip.add (i, j, std::min (1ll * k * w, 10000000ll));
@@ -72,14 +99,19 @@ inline auto find_matching_heavy (SimpleRoute const& tour, std::vector<int> selec
 
   ASSERT (matched == selection.size ());
 
-  bip.for_each_match ([&] (int from, int to) { result.emplace_back (from, to); });
+  bip.for_each_match ([&] (int from, int to) { result.emplace_back (selection[from], to); });
 
   return result;
 }
 
-inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double allowed_ms) -> std::pair<SimpleRoute, StoneMatching>
+// Publishes the solutions it improves to output, when given.
+template<class Rng>
+inline auto solve_general (Dataset const& dataset, Rng& rng, double allowed_ms, AnytimeOutput* output = nullptr)
+  -> std::pair<SimpleRoute, StoneMatching>
 {
+  TRACE_SPAN ("solve_general");
   auto const timer = Timer ();
+  auto& counters = telemetry ();
 
   auto tour = [&] () {
     auto indices = std::vector<int> (dataset.num_cities ());
@@ -100,12 +132,17 @@ inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double all
 
   for (auto select_strategy : {select_knapsack}) {
     auto found = std::vector<std::pair<int, int>> ();
-    auto selected = select_strategy (dataset);
+    auto selected = select_strategy (dataset, (allowed_ms * 0.95 - timer.elapsed_ms ()) * 0.5);
 
-    if (selected.size () <= 170) {
+    auto edges = 0ll;
+    for (auto i : selected)
+      edges += dataset.cities_with_stone (i).size ();
+
+    // the assignment explores up to all the edges for every stone, keep it within ~100ms
+    if (edges <= 100000) {
       found = find_matching_heavy (tour, std::move (selected));
     } else {
-      found = find_matching (dataset, select_strategy (dataset));
+      found = find_matching (dataset, std::move (selected));
     }
     auto curr = StoneMatching (dataset);
     for (auto e : found)
@@ -135,10 +172,10 @@ inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double all
       std::swap (c1, c2);
     }
 
-    if (dataset.stone (x).weight < dataset.stone (y).weight)
-      return;
-
-    if (dataset.city_has_stone (c1, y) && dataset.city_has_stone (c2, x)) {
+    auto const accepted = dataset.stone (x).weight >= dataset.stone (y).weight
+      && dataset.city_has_stone (c1, y) && dataset.city_has_stone (c2, x);
+    counters.move (Move::stone_pair, accepted);
+    if (accepted) {
       matching.unmatch (x);
       matching.unmatch (y);
       matching.match (x, c2);
@@ -149,7 +186,9 @@ inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double all
   auto const improve_stone_pos = [&] (int x) {
     for (auto c2 : dataset.cities_with_stone (x)) {
       auto c1 = matching.matched_city (x);
-      if (!matching.is_city_matched (c2) && tour.city_index (c2) > tour.city_index (c1)) {
+      auto const accepted = !matching.is_city_matched (c2) && tour.city_index (c2) > tour.city_index (c1);
+      counters.move (Move::stone_position, accepted);
+      if (accepted) {
         matching.unmatch (x);
         matching.match (x, c2);
       }
@@ -159,8 +198,10 @@ inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double all
   auto const improve_reverse = [&] (int left, int right) {
     tour.reverse (left, right);
     auto new_score = evaluate (tour, matching);
+    counters.move (Move::reverse, new_score.score > best_score.score);
     if (new_score.score > best_score.score) {
       best_score = new_score;
+      counters.improved (best_score.score);
     } else {
       tour.reverse (left, right);
     }
@@ -178,23 +219,25 @@ inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double all
 
   best_score = evaluate (tour, matching);
   auto initial_score = best_score;
+  counters.improved (best_score.score);
 
   auto indices = std::vector<int> ();
   int iters = 0;
   auto const improve_round = [&] () {
     ++iters;
+    ++counters.rounds;
 
     for (int i = 0; i < 20; ++i) {
-      int x = rng () % stones.size ();
-      int y = rng () % stones.size ();
+      int x = random_below (rng, stones.size ());
+      int y = random_below (rng, stones.size ());
       if (x != y) {
         improve_stone_pair (stones[x], stones[y]);
       }
     }
 
     for (int i = 0; i < 20; ++i) {
-      int x = rng () % (dataset.num_cities () - 1) + 1;
-      int y = rng () % (dataset.num_cities () - 1) + 1;
+      int x = random_below (rng, dataset.num_cities () - 1) + 1;
+      int y = random_below (rng, dataset.num_cities () - 1) + 1;
       if (y < x)
         std::swap (x, y);
       if (x != y) {
@@ -203,49 +246,78 @@ inline auto solve_general (Dataset const& dataset, std::mt19937& rng, double all
     }
   };
 
-  while (timer.elapsed_ms () < allowed_ms * 0.95)
-    improve_round ();
-  best_score = evaluate (tour, matching);
-
-  for (auto s : stones) {
-    auto c = matching.matched_city (s);
-    matching.unmatch (s);
-    auto new_score = evaluate (tour, matching);
-    if (new_score.score > best_score.score) {
-      best_score = new_score;
-    } else {
-      matching.match (s, c);
+  auto const publish = [&] () {
+    if (output != nullptr)
+      output->publish (tour, matching);
+  };
+  publish ();
+
+  {
+    TRACE_SPAN ("improve_rounds");
+    while (timer.elapsed_ms () < allowed_ms * 0.95) {
+      improve_round ();
+      if (iters % 256 == 0)
+        publish ();
     }
   }
-  for (auto s : stones)
-    if (matching.is_stone_matched (s))
-      improve_stone_pos (s);
-  for (int i = 0; i < dataset.num_stones (); ++i) {
-    if (!matching.is_stone_matched (i)) {
-      if (matching.fits (dataset.stone (i).weight)) {
-        auto k = -1;
-        for (auto j : dataset.cities_with_stone (i))
-          if (!matching.is_city_matched (j))
-            if (k == -1 || tour.city_index (j) > tour.city_index (k))
-              k = j;
-        if (k == -1)
-          continue;
-        matching.match (i, k);
-        auto new_score = evaluate (tour, matching);
-        if (new_score.score > best_score.score) {
-          best_score = new_score;
-          stones.push_back (k);
-        } else {
-          matching.unmatch (i);
+  best_score = evaluate (tour, matching);
+  publish ();
+
+  {
+    TRACE_SPAN ("polish");
+    for (auto s : stones) {
+      auto c = matching.matched_city (s);
+      matching.unmatch (s);
+      auto new_score = evaluate (tour, matching);
+      counters.move (Move::drop_stone, new_score.score > best_score.score);
+      if (new_score.score > best_score.score) {
+        best_score = new_score;
+        counters.improved (best_score.score);
+      } else {
+        matching.match (s, c);
+      }
+    }
+    for (auto s : stones)
+      if (matching.is_stone_matched (s))
+        improve_stone_pos (s);
+    for (int i = 0; i < dataset.num_stones (); ++i) {
+      if (!matching.is_stone_matched (i)) {
+        if (matching.fits (dataset.stone (i).weight)) {
+          auto k = -1;
+          for (auto j : dataset.cities_with_stone (i))
+            if (!matching.is_city_matched (j))
+              if (k == -1 || tour.city_index (j) > tour.city_index (k))
+                k = j;
+          if (k == -1)
+            continue;
+          matching.match (i, k);
+          auto new_score = evaluate (tour, matching);
+          counters.move (Move::add_stone, new_score.score > best_score.score);
+          if (new_score.score > best_score.score) {
+            best_score = new_score;
+            counters.improved (best_score.score);
+            stones.push_back (k);
+          } else {
+            matching.unmatch (i);
+          }
         }
       }
     }
+
+    auto last = std::remove_if (
+      stones.begin (), stones.end (), [&] (int id) { return !matching.is_stone_matched (id); });
+    stones.erase (last, stones.end ());
+    publish ();
   }
 
-  auto last = std::remove_if (stones.begin (), stones.end (), [&] (int id) { return !matching.is_stone_matched (id); });
-  stones.erase (last, stones.end ());
-  while (timer.elapsed_ms () < allowed_ms)
-    improve_round ();
+  {
+    TRACE_SPAN ("improve_rounds_final");
+    while (timer.elapsed_ms () < allowed_ms) {
+      improve_round ();
+      if (iters % 256 == 0)
+        publish ();
+    }
+  }
 
   return {std::move (tour), std::move (matching)};
 }
\ No newline at end of file
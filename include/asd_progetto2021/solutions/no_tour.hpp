@@ -1,4 +1,5 @@
 #pragma once
+#include <asd_progetto2021/dataset/stone_items.hpp>
 #include <asd_progetto2021/dataset/stone_matching.hpp>
 #include <asd_progetto2021/dataset/tour.hpp>
 #include <asd_progetto2021/opt/bipartite_matching.hpp>
@@ -9,20 +10,21 @@
 #include <numeric>
 #include <random>
 
-inline auto solve_no_tour (Dataset const& dataset, std::mt19937& rng, double allowed_ms) -> StoneMatching
+template<class Rng>
+inline auto solve_no_tour (Dataset const& dataset, Rng& rng, double allowed_ms) -> StoneMatching
 {
   auto const timer = Timer ();
 
-  auto indices = std::vector<int> (dataset.num_stones ());
+  auto const items = preprocess_stones (dataset.stones (), dataset.glove_capacity ());
+  auto indices = std::vector<int> (items.size ());
   std::iota (indices.begin (), indices.end (), 0);
 
-  auto const weight_fn = [&] (int id) -> int { return dataset.stone (id).weight; };
-  auto const value_fn = [&] (int id) -> long long { return dataset.stone (id).energy; };
+  auto const weight_fn = [&] (int id) -> int { return items[id].weight; };
+  auto const value_fn = [&] (int id) -> long long { return items[id].energy; };
 
   std::sort (indices.begin (), indices.end (), [&] (int a, int b) { return weight_fn (a) > weight_fn (b); });
-  auto knapsack_result = Knapsack::knapsack (dataset.glove_capacity (), indices.begin (), indices.end (), weight_fn, value_fn);
-
-  ASSERT (knapsack_result.exact == true);
+  auto knapsack_result = Knapsack::knapsack (items.capacity, indices.begin (), indices.end (), weight_fn, value_fn);
+  knapsack_result.selection = items.expand (knapsack_result.selection);
 
   auto matching_result = [&] () {
     if (knapsack_result.selection.size () < dataset.num_cities ()) {
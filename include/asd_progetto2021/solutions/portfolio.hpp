@@ -0,0 +1,49 @@
+#pragma once
+#include <asd_progetto2021/dataset/evaluation.hpp>
+#include <asd_progetto2021/dataset/stone_matching.hpp>
+#include <asd_progetto2021/dataset/tour.hpp>
+#include <asd_progetto2021/utilities/assert.hpp>
+#include <asd_progetto2021/utilities/random.hpp>
+#include <asd_progetto2021/utilities/thread_pool.hpp>
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using PortfolioSolution = std::pair<SimpleRoute, StoneMatching>;
+using PortfolioSolver = std::function<PortfolioSolution (Random&, double)>;
+
+// Runs every solver as a task of the pool, with the stream of seed numbered by its position and
+// allowed_ms of its own thread cpu time, and returns the solution with the best score.
+// Solvers share nothing but the dataset, which they only read. Solvers are meant to run at once,
+// so the pool needs solvers.size () - 1 threads, the caller runs the last one.
+inline auto solve_portfolio (ThreadPool& pool,
+  std::vector<PortfolioSolver> const& solvers,
+  std::uint64_t seed,
+  double allowed_ms) -> PortfolioSolution
+{
+  ASSERT (!solvers.empty ());
+
+  auto results = std::vector<std::unique_ptr<PortfolioSolution>> (solvers.size ());
+  auto tasks = std::vector<ThreadPool::TaskHandle> ();
+  for (int k = 0; k < (int)solvers.size (); ++k) {
+    tasks.push_back (pool.spawn ([&, k] () {
+      auto rng = Random (seed, k + 1);
+      results[k].reset (new PortfolioSolution (solvers[k](rng, allowed_ms)));
+    }));
+  }
+  for (auto const& task : tasks)
+    pool.wait (task);
+
+  auto best = 0;
+  auto best_score = evaluate (results[0]->first, results[0]->second).score;
+  for (int k = 1; k < (int)results.size (); ++k) {
+    auto const score = evaluate (results[k]->first, results[k]->second).score;
+    if (score > best_score) {
+      best = k;
+      best_score = score;
+    }
+  }
+  return std::move (*results[best]);
+}
@@ -1,24 +1,25 @@
 #pragma once
 #include <asd_progetto2021/dataset/dataset.hpp>
+#include <asd_progetto2021/dataset/stone_items.hpp>
 #include <asd_progetto2021/opt/knapsack.hpp>
 
 #include <iostream>
 #include <numeric>
 #include <random>
 
-inline auto solve_selection_only (Dataset const& dataset, std::mt19937& rng) -> std::vector<int>
+template<class Rng>
+inline auto solve_selection_only (Dataset const& dataset, Rng& rng) -> std::vector<int>
 {
-  auto indices = std::vector<int> (dataset.num_stones ());
+  auto const items = preprocess_stones (dataset.stones (), dataset.glove_capacity ());
+  auto indices = std::vector<int> (items.size ());
   std::iota (indices.begin (), indices.end (), 0);
 
   auto result = Knapsack::knapsack (
-    dataset.glove_capacity (),
+    items.capacity,
     indices.begin (),
     indices.end (),
-    [&] (int id) -> int { return dataset.stone (id).weight; },
-    [&] (int id) -> long long { return dataset.stone (id).energy; });
+    [&] (int id) -> int { return items[id].weight; },
+    [&] (int id) -> long long { return items[id].energy; });
 
-  ASSERT (result.exact == true);
-
-  return result.selection;
+  return items.expand (result.selection);
 }
\ No newline at end of file
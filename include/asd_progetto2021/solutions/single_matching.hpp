@@ -1,4 +1,6 @@
 #pragma once
+#include <asd_progetto2021/dataset/anytime_output.hpp>
+#include <asd_progetto2021/dataset/stone_items.hpp>
 #include <asd_progetto2021/dataset/stone_matching.hpp>
 #include <asd_progetto2021/dataset/tour.hpp>
 #include <asd_progetto2021/opt/bipartite_matching.hpp>
@@ -9,24 +11,30 @@
 #include <numeric>
 #include <random>
 
-inline auto solve_single_matching (Dataset const& dataset, std::mt19937& rng, double allowed_ms) -> std::pair<SimpleRoute, StoneMatching>
+// Publishes the matching with the identity tour to output before looking for a tour, when given.
+template<class Rng>
+inline auto solve_single_matching (Dataset const& dataset,
+  Rng& rng,
+  double allowed_ms,
+  AnytimeOutput* output = nullptr) -> std::pair<SimpleRoute, StoneMatching>
 {
   auto const timer = Timer ();
 
-  auto indices = std::vector<int> (dataset.num_stones ());
+  auto const items = preprocess_stones (dataset.stones (), dataset.glove_capacity ());
+  auto indices = std::vector<int> (items.size ());
   std::iota (indices.begin (), indices.end (), 0);
 
-  auto const weight_fn = [&] (int id) -> int { return dataset.stone (id).weight; };
-  auto const value_fn = [&] (int id) -> long long { return dataset.stone (id).energy; };
+  auto const weight_fn = [&] (int id) -> int { return items[id].weight; };
+  auto const value_fn = [&] (int id) -> long long { return items[id].energy; };
 
-  auto selected = Knapsack::knapsack (dataset.glove_capacity (), indices.begin (), indices.end (), weight_fn, value_fn);
-
-  ASSERT (selected.exact == true);
+  auto selected = Knapsack::knapsack (items.capacity, indices.begin (), indices.end (), weight_fn, value_fn);
 
   auto matching = StoneMatching (dataset);
-  for (auto i : selected.selection)
+  for (auto i : items.expand (selected.selection))
     if (matching.fits (dataset.stone (i).weight))
       matching.match (i, dataset.cities_with_stone (i).at (0));
+  if (output != nullptr)
+    output->publish (SimpleRoute (dataset), matching);
 
   indices.resize (dataset.num_cities ());
   std::iota (indices.begin (), indices.end (), 0);
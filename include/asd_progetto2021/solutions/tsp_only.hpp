@@ -1,4 +1,5 @@
 #pragma once
+#include <asd_progetto2021/dataset/anytime_output.hpp>
 #include <asd_progetto2021/dataset/tour.hpp>
 #include <asd_progetto2021/opt/tsp.hpp>
 
@@ -8,8 +9,19 @@
 #include <random>
 #include <unordered_set>
 
-inline auto solve_tsp_only (Dataset const& dataset, std::mt19937& rng, double allowed_ms) -> SimpleRoute
+// Publishes the tours it improves to output, when given.
+template<class Rng>
+inline auto solve_tsp_only (Dataset const& dataset, Rng& rng, double allowed_ms, AnytimeOutput* output = nullptr)
+  -> SimpleRoute
 {
+  auto const publish = [&] (int const* first, int n) {
+    if (output == nullptr)
+      return;
+    auto tour = std::vector<int> (first, first + n);
+    std::rotate (tour.begin (), std::find (tour.begin (), tour.end (), dataset.starting_city ()), tour.end ());
+    output->publish (SimpleRoute (dataset, tour.data (), tour.data () + n), StoneMatching (dataset));
+  };
+
   auto indices = std::vector<int> (dataset.num_cities ());
   std::iota (indices.begin (), indices.end (), 0);
   auto cost = Tsp::tsp (
@@ -18,7 +30,8 @@ inline auto solve_tsp_only (Dataset const& dataset, std::mt19937& rng, double al
     dataset.starting_city (), //
     [&] (int from, int to) { return dataset.distance (from, to); },
     rng,
-    allowed_ms);
+    allowed_ms,
+    publish);
 
   return SimpleRoute (dataset, indices.data (), indices.data () + indices.size ());
 }
\ No newline at end of file
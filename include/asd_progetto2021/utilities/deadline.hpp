@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <asd_progetto2021/utilities/timer.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Wall clock read from the time stamp counter, calibrated once against steady_clock.
+// Falls back to steady_clock where there is no counter.
+struct TickClock
+{
+  static auto now () -> long long
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc ();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ())
+      .count ();
+#endif
+  }
+
+  // Spins for about a millisecond the first time it is called.
+  static auto ticks_per_ms () -> double
+  {
+    static auto const ticks = [] () {
+      using std::chrono::steady_clock;
+      auto const start = steady_clock::now ();
+      auto const start_ticks = now ();
+      auto elapsed = steady_clock::duration ();
+      while (elapsed < std::chrono::milliseconds (1))
+        elapsed = steady_clock::now () - start;
+      return (now () - start_ticks) / std::chrono::duration<double, std::milli> (elapsed).count ();
+    }();
+    return ticks;
+  }
+};
+
+constexpr auto UNLIMITED_MS = std::numeric_limits<double>::infinity ();
+
+// Budgets of wall time and of cpu time of the owning thread, counted from construction.
+// expired () costs a read of the time stamp counter: the thread cpu time is only read once the
+// wall time could have used up what is left of the cpu budget, since a thread can't get more cpu
+// time than wall time. A deadline must only be checked by the thread that created it.
+struct Deadline
+{
+private:
+  Timer _cpu_timer {};
+  long long _start = TickClock::now ();
+  double _ticks_per_ms = TickClock::ticks_per_ms ();
+  double _cpu_ms = UNLIMITED_MS;
+  double _wall_ms = UNLIMITED_MS;
+
+  // wall deadline, or the earliest time the cpu budget could run out
+  long long _next_check = 0;
+  bool _expired = false;
+
+  auto schedule (long long now) -> void
+  {
+    auto const wall_left = _wall_ms - (now - _start) / _ticks_per_ms;
+    auto const cpu_left = _cpu_ms - _cpu_timer.elapsed_ms ();
+    _expired = wall_left <= 0.0 || cpu_left <= 0.0;
+
+    // round up to at least a tick, and keep far deadlines from overflowing
+    auto const wait_ms = std::min (std::min (wall_left, cpu_left), 1e9);
+    _next_check = now + 1 + (long long)(wait_ms * _ticks_per_ms);
+  }
+
+public:
+  explicit Deadline (double cpu_ms = UNLIMITED_MS, double wall_ms = UNLIMITED_MS)
+  {
+    set_budget (cpu_ms, wall_ms);
+  }
+
+  // Replaces the budgets, still counted from construction.
+  auto set_budget (double cpu_ms, double wall_ms = UNLIMITED_MS) -> void
+  {
+    _cpu_ms = cpu_ms;
+    _wall_ms = wall_ms;
+    schedule (TickClock::now ());
+  }
+
+  auto expired () -> bool
+  {
+    if (_expired)
+      return true;
+    auto const now = TickClock::now ();
+    if (now >= _next_check)
+      schedule (now);
+    return _expired;
+  }
+
+  auto wall_elapsed_ms () const -> double
+  {
+    return (TickClock::now () - _start) / _ticks_per_ms;
+  }
+
+  auto cpu_elapsed_ms () const -> double
+  {
+    return _cpu_timer.elapsed_ms ();
+  }
+};
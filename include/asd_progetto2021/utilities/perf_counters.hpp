@@ -0,0 +1,160 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+enum class PerfEvent
+{
+  cycles,
+  instructions,
+  l1d_misses,
+  llc_misses,
+  branch_misses
+};
+
+constexpr auto NUM_PERF_EVENTS = 5;
+
+inline auto perf_event_name (PerfEvent event) -> char const*
+{
+  switch (event) {
+    case PerfEvent::cycles:
+      return "cycles";
+    case PerfEvent::instructions:
+      return "instructions";
+    case PerfEvent::l1d_misses:
+      return "l1d_misses";
+    case PerfEvent::llc_misses:
+      return "llc_misses";
+    case PerfEvent::branch_misses:
+      return "branch_misses";
+  }
+  return "";
+}
+
+// Counts of the events of a region, -1 for the events that could not be counted.
+struct PerfSample
+{
+  long long values[NUM_PERF_EVENTS] = {-1, -1, -1, -1, -1};
+
+  auto operator[] (PerfEvent event) const -> long long
+  {
+    return values[(int)event];
+  }
+
+  // an event missing from either sample is missing from the sum
+  auto operator+= (PerfSample const& other) -> PerfSample&
+  {
+    for (int i = 0; i < NUM_PERF_EVENTS; ++i)
+      values[i] = values[i] < 0 || other.values[i] < 0 ? -1 : values[i] + other.values[i];
+    return *this;
+  }
+};
+
+// Hardware counters of the calling thread in user space, read with perf_event_open.
+// Every event is opened on its own, so the events the cpu, the kernel or perf_event_paranoid
+// don't allow are just missing, and without perf events every count is -1. When the events
+// outnumber the hardware counters, the kernel multiplexes them and the counts are scaled.
+struct PerfCounters
+{
+private:
+  int _fds[NUM_PERF_EVENTS] = {-1, -1, -1, -1, -1};
+
+#ifdef __linux__
+  static auto open_event (std::uint32_t type, std::uint64_t config) -> int
+  {
+    auto attr = perf_event_attr ();
+    std::memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+
+public:
+  // Opens nothing when open is false, so that the counters can stay optional.
+  explicit PerfCounters (bool open = true)
+  {
+#ifdef __linux__
+    if (!open)
+      return;
+    auto const l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    _fds[(int)PerfEvent::cycles] = open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    _fds[(int)PerfEvent::instructions] = open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    _fds[(int)PerfEvent::l1d_misses] = open_event (PERF_TYPE_HW_CACHE, l1d_read_miss);
+    _fds[(int)PerfEvent::llc_misses] = open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    _fds[(int)PerfEvent::branch_misses] = open_event (PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#else
+    (void)open;
+#endif
+  }
+
+  PerfCounters (PerfCounters const&) = delete;
+  PerfCounters& operator= (PerfCounters const&) = delete;
+
+  ~PerfCounters ()
+  {
+#ifdef __linux__
+    for (auto fd : _fds)
+      if (fd != -1)
+        close (fd);
+#endif
+  }
+
+  auto available (PerfEvent event) const -> bool
+  {
+    return _fds[(int)event] != -1;
+  }
+
+  auto any_available () const -> bool
+  {
+    for (auto fd : _fds)
+      if (fd != -1)
+        return true;
+    return false;
+  }
+
+  // Resets and starts the counters.
+  auto start () -> void
+  {
+#ifdef __linux__
+    for (auto fd : _fds) {
+      if (fd == -1)
+        continue;
+      ioctl (fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  // Stops the counters and returns the counts since start.
+  auto stop () -> PerfSample
+  {
+    auto sample = PerfSample ();
+#ifdef __linux__
+    for (auto fd : _fds)
+      if (fd != -1)
+        ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int i = 0; i < NUM_PERF_EVENTS; ++i) {
+      // value, time enabled, time running
+      std::uint64_t data[3] = {};
+      if (_fds[i] == -1 || read (_fds[i], data, sizeof (data)) != sizeof (data) || data[2] == 0)
+        continue;
+      sample.values[i] = (long long)(data[0] * ((double)data[1] / data[2]));
+    }
+#endif
+    return sample;
+  }
+};
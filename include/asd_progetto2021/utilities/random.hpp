@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+#include <asd_progetto2021/utilities/assert.hpp>
+
+// xoshiro256** by Blackman and Vigna, a small and fast UniformRandomBitGenerator.
+// The state of stream k of a seed is hashed from the pair with splitmix64, so every thread can
+// draw its own reproducible sequence from a single seed.
+struct Xoshiro256
+{
+  using result_type = std::uint64_t;
+
+private:
+  std::uint64_t _state[4];
+
+  static auto rotl (std::uint64_t x, int k) -> std::uint64_t
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  static auto splitmix64 (std::uint64_t& x) -> std::uint64_t
+  {
+    auto z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+public:
+  explicit Xoshiro256 (std::uint64_t seed = 0, std::uint64_t stream = 0)
+  {
+    auto x = splitmix64 (seed) ^ stream;
+    for (auto& s : _state)
+      s = splitmix64 (x);
+  }
+
+  static constexpr auto min () -> result_type
+  {
+    return 0;
+  }
+
+  static constexpr auto max () -> result_type
+  {
+    return std::numeric_limits<result_type>::max ();
+  }
+
+  auto operator() () -> result_type
+  {
+    auto const result = rotl (_state[1] * 5, 7) * 9;
+    auto const t = _state[1] << 17;
+    _state[2] ^= _state[0];
+    _state[3] ^= _state[1];
+    _state[1] ^= _state[2];
+    _state[0] ^= _state[3];
+    _state[2] ^= t;
+    _state[3] = rotl (_state[3], 45);
+    return result;
+  }
+};
+
+// Generator used by the solvers.
+using Random = Xoshiro256;
+
+// Streams of a seed: 0 for the single threaded solver, k + 1 for the k-th solver of a portfolio,
+// this one for the sampling of the input, far from any number of threads.
+constexpr auto PARSING_STREAM = std::numeric_limits<std::uint64_t>::max ();
+
+// Uniform integer in [0, bound) from the low 32 bits of rng, with Lemire's multiply and shift:
+// a division only happens on the rare draws that must be rejected.
+template<class Rng>
+inline auto random_below (Rng& rng, std::uint32_t bound) -> std::uint32_t
+{
+  ASSERT (bound > 0);
+  auto product = std::uint64_t (std::uint32_t (rng ())) * bound;
+  if (std::uint32_t (product) < bound) {
+    auto const threshold = std::uint32_t (-bound) % bound;
+    while (std::uint32_t (product) < threshold)
+      product = std::uint64_t (std::uint32_t (rng ())) * bound;
+  }
+  return product >> 32;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <asd_progetto2021/utilities/deadline.hpp>
+
+// Moves of the local search of solve_general.
+enum class Move
+{
+  stone_pair,
+  stone_position,
+  reverse,
+  drop_stone,
+  add_stone
+};
+
+constexpr auto NUM_MOVES = 5;
+constexpr auto MAX_IMPROVEMENTS = 256;
+
+inline auto move_name (Move move) -> char const*
+{
+  switch (move) {
+    case Move::stone_pair:
+      return "stone_pair";
+    case Move::stone_position:
+      return "stone_position";
+    case Move::reverse:
+      return "reverse";
+    case Move::drop_stone:
+      return "drop_stone";
+    case Move::add_stone:
+      return "add_stone";
+  }
+  return "";
+}
+
+// Counters of the search run by a thread, and the last MAX_IMPROVEMENTS scores it reached.
+// Updating them costs an increment or a read of the time stamp counter, so they are always kept.
+struct Telemetry
+{
+  struct Improvement
+  {
+    long long ticks;
+    double score;
+  };
+
+  long long rounds = 0;
+  long long tried[NUM_MOVES] {};
+  long long accepted[NUM_MOVES] {};
+
+  // ring buffer, the oldest improvements are overwritten
+  Improvement improvements[MAX_IMPROVEMENTS] {};
+  long long num_improvements = 0;
+
+  auto move (Move move, bool was_accepted) -> void
+  {
+    ++tried[(int)move];
+    accepted[(int)move] += was_accepted;
+  }
+
+  auto improved (double score) -> void
+  {
+    improvements[num_improvements++ % MAX_IMPROVEMENTS] = {TickClock::now (), score};
+  }
+};
+
+struct TelemetryRegistry
+{
+  std::mutex mutex;
+  std::vector<Telemetry const*> running;
+  std::vector<Telemetry> finished;
+
+  // time stamp counter when the first thread started counting
+  long long start = TickClock::now ();
+};
+
+inline auto telemetry_registry () -> TelemetryRegistry&
+{
+  static TelemetryRegistry registry;
+  return registry;
+}
+
+// Telemetry of the calling thread, kept in the registry when the thread exits.
+inline auto telemetry () -> Telemetry&
+{
+  struct ThreadTelemetry
+  {
+    Telemetry telemetry;
+
+    ThreadTelemetry ()
+    {
+      auto& registry = telemetry_registry ();
+      std::lock_guard<std::mutex> lock (registry.mutex);
+      registry.running.push_back (&telemetry);
+    }
+
+    ~ThreadTelemetry ()
+    {
+      auto& registry = telemetry_registry ();
+      std::lock_guard<std::mutex> lock (registry.mutex);
+      registry.running.erase (std::find (registry.running.begin (), registry.running.end (), &telemetry));
+      registry.finished.push_back (telemetry);
+    }
+  };
+
+  thread_local ThreadTelemetry thread_telemetry;
+  return thread_telemetry.telemetry;
+}
+
+// Writes the telemetry of every thread as json when ASD_TELEMETRY is set: to stderr when it is
+// "stderr", else to the file it names. Times are in milliseconds since the first thread started.
+// Must be called once the searches are over.
+inline auto dump_telemetry () -> void
+{
+  auto const path = std::getenv ("ASD_TELEMETRY");
+  if (path == nullptr || *path == '\0')
+    return;
+  auto const os = std::strcmp (path, "stderr") == 0 ? stderr : std::fopen (path, "w");
+  if (os == nullptr)
+    return;
+
+  auto& registry = telemetry_registry ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  auto threads = registry.finished;
+  for (auto t : registry.running)
+    threads.push_back (*t);
+
+  auto const ticks_per_ms = TickClock::ticks_per_ms ();
+  fprintf (os, "{\"threads\": [");
+  for (int k = 0; k < (int)threads.size (); ++k) {
+    auto const& t = threads[k];
+    fprintf (os, "%s\n  {\"rounds\": %lld, \"moves\": {", k == 0 ? "" : ",", t.rounds);
+    for (int m = 0; m < NUM_MOVES; ++m)
+      fprintf (os,
+        "%s\"%s\": {\"tried\": %lld, \"accepted\": %lld}",
+        m == 0 ? "" : ", ",
+        move_name ((Move)m),
+        t.tried[m],
+        t.accepted[m]);
+
+    auto const first = std::max (0ll, t.num_improvements - MAX_IMPROVEMENTS);
+    fprintf (os, "},\n   \"dropped_improvements\": %lld, \"improvements\": [", first);
+    for (auto i = first; i < t.num_improvements; ++i) {
+      auto const& event = t.improvements[i % MAX_IMPROVEMENTS];
+      fprintf (os,
+        "%s[%.3f, %.3f]",
+        i == first ? "" : ", ",
+        (event.ticks - registry.start) / ticks_per_ms,
+        event.score);
+    }
+    fprintf (os, "]}");
+  }
+  fprintf (os, "\n]}\n");
+
+  if (os != stderr)
+    std::fclose (os);
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asd_progetto2021/utilities/assert.hpp>
+
+// Fork-join pool with one task deque per worker.
+// Workers pop from the back of their own deque and steal from the front of the others.
+// A thread waiting for a task keeps running pending tasks, so nested fork-join never deadlocks.
+// An exception thrown by a task is kept and rethrown by wait.
+struct ThreadPool
+{
+  struct Task
+  {
+    std::function<void ()> fn;
+    std::exception_ptr error;
+    std::atomic<bool> done {false};
+  };
+
+  using TaskHandle = std::shared_ptr<Task>;
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<TaskHandle> tasks;
+  };
+
+  struct WorkerId
+  {
+    ThreadPool const* pool;
+    int index;
+  };
+
+  // queue 0 is shared by all threads not owned by the pool
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _workers;
+  std::atomic<bool> _stop {false};
+  std::atomic<int> _queued {0};
+  std::mutex _sleep_mutex;
+  std::condition_variable _sleep_cv;
+
+  static auto current_worker () -> WorkerId&
+  {
+    thread_local WorkerId id {nullptr, 0};
+    return id;
+  }
+
+  auto local_queue () const -> int
+  {
+    return current_worker ().pool == this ? current_worker ().index : 0;
+  }
+
+  auto pop (int queue_id) -> TaskHandle
+  {
+    auto const n = (int)_queues.size ();
+    for (int i = 0; i < n; ++i) {
+      auto& queue = *_queues[(queue_id + i) % n];
+      std::lock_guard<std::mutex> lock (queue.mutex);
+      if (queue.tasks.empty ())
+        continue;
+
+      auto task = TaskHandle ();
+      if (i == 0) {
+        task = std::move (queue.tasks.back ());
+        queue.tasks.pop_back ();
+      } else {
+        task = std::move (queue.tasks.front ());
+        queue.tasks.pop_front ();
+      }
+      _queued--;
+      return task;
+    }
+    return nullptr;
+  }
+
+  auto try_run_one (int queue_id) -> bool
+  {
+    auto task = pop (queue_id);
+    if (!task)
+      return false;
+    try {
+      task->fn ();
+    } catch (...) {
+      task->error = std::current_exception ();
+    }
+    task->fn = nullptr;
+    task->done.store (true, std::memory_order_release);
+    return true;
+  }
+
+  auto worker_loop (int index) -> void
+  {
+    current_worker () = {this, index};
+    while (!_stop.load ()) {
+      if (try_run_one (index))
+        continue;
+
+      std::unique_lock<std::mutex> lock (_sleep_mutex);
+      _sleep_cv.wait (lock, [this] () { return _stop.load () || _queued.load () > 0; });
+    }
+  }
+
+public:
+  explicit ThreadPool (int num_threads = std::thread::hardware_concurrency ())
+  {
+    ASSERT (num_threads >= 0);
+    for (int i = 0; i <= num_threads; ++i)
+      _queues.emplace_back (new Queue ());
+    for (int i = 1; i <= num_threads; ++i)
+      _workers.emplace_back ([this, i] () { worker_loop (i); });
+  }
+
+  ThreadPool (ThreadPool const&) = delete;
+  ThreadPool& operator= (ThreadPool const&) = delete;
+
+  ~ThreadPool ()
+  {
+    {
+      std::lock_guard<std::mutex> lock (_sleep_mutex);
+      _stop = true;
+    }
+    _sleep_cv.notify_all ();
+    for (auto& worker : _workers)
+      worker.join ();
+  }
+
+  auto num_threads () const -> int
+  {
+    return _workers.size ();
+  }
+
+  // In [1, num_threads] for the workers of this pool, 0 for every other thread.
+  auto thread_index () const -> int
+  {
+    return local_queue ();
+  }
+
+  template<class Fn>
+  auto spawn (Fn fn) -> TaskHandle
+  {
+    auto task = std::make_shared<Task> ();
+    task->fn = std::move (fn);
+
+    auto& queue = *_queues[local_queue ()];
+    {
+      std::lock_guard<std::mutex> lock (queue.mutex);
+      queue.tasks.push_back (task);
+    }
+    _queued++;
+
+    { std::lock_guard<std::mutex> lock (_sleep_mutex); }
+    _sleep_cv.notify_one ();
+    return task;
+  }
+
+  // Rethrows the exception the task threw, if any.
+  auto wait (TaskHandle const& task) -> void
+  {
+    auto const queue_id = local_queue ();
+    while (!task->done.load (std::memory_order_acquire))
+      if (!try_run_one (queue_id))
+        std::this_thread::yield ();
+    if (task->error)
+      std::rethrow_exception (task->error);
+  }
+};
@@ -1,16 +1,29 @@
 #pragma once
 #include <ctime>
 
+// Measures the cpu time of the calling thread, so solvers running side by side each see their
+// own budget. A timer must only be read by the thread that created it.
 struct Timer
 {
 private:
-  std::clock_t time_start = std::clock ();
+  double time_start = now_ms ();
+
+  static auto now_ms () -> double
+  {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    auto now = timespec ();
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+#else
+    return std::clock () * 1000.0 / CLOCKS_PER_SEC;
+#endif
+  }
 
 public:
   Timer () = default;
 
   auto elapsed_ms () const -> double
   {
-    return std::difftime (std::clock (), time_start) * 1000.0 / CLOCKS_PER_SEC;
+    return now_ms () - time_start;
   }
-};
\ No newline at end of file
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include <asd_progetto2021/utilities/assert.hpp>
+
+// TRACE_SPAN ("name") records the time from there to the end of the enclosing scope, TRACE_WRITE ()
+// writes the spans recorded so far in the Chrome trace event format, for chrome://tracing or
+// Perfetto. Spans are only recorded when ASD_TRACE is set: to stderr when it is "stderr", else to
+// the file it names. Names must be string literals. Both compile to nothing under EVAL or RELEASE.
+
+#if defined(EVAL) || defined(RELEASE)
+
+#  define TRACE_SPAN(name) (void)0
+#  define TRACE_WRITE() (void)0
+
+#else
+
+#  include <atomic>
+#  include <cstdio>
+#  include <cstdlib>
+#  include <cstring>
+#  include <mutex>
+#  include <vector>
+
+#  define TRACE_CONCAT_IMPL(a, b) a##b
+#  define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL (a, b)
+#  define TRACE_SPAN(name) TraceSpan TRACE_CONCAT (trace_span_, __LINE__) (name)
+#  define TRACE_WRITE() write_trace ()
+
+struct TraceEvent
+{
+  char const* name;
+  int thread;
+  double start_us;
+  double duration_us;
+};
+
+struct TraceLog
+{
+  std::mutex mutex;
+  std::vector<TraceEvent> events;
+  char const* path = std::getenv ("ASD_TRACE");
+  TimePoint start = Clock::now ();
+};
+
+inline auto trace_log () -> TraceLog&
+{
+  static TraceLog log;
+  return log;
+}
+
+inline auto trace_thread () -> int
+{
+  static std::atomic<int> next {0};
+  thread_local int thread = next++;
+  return thread;
+}
+
+struct TraceSpan
+{
+private:
+  char const* _name;
+  TimePoint _start;
+
+public:
+  explicit TraceSpan (char const* name)
+    : _name (trace_log ().path != nullptr ? name : nullptr), //
+      _start (Clock::now ())
+  {}
+
+  TraceSpan (TraceSpan const&) = delete;
+  TraceSpan& operator= (TraceSpan const&) = delete;
+
+  ~TraceSpan ()
+  {
+    if (_name == nullptr)
+      return;
+
+    using Micro = std::chrono::duration<double, std::micro>;
+    auto const end = Clock::now ();
+    auto& log = trace_log ();
+    auto const event = TraceEvent {_name, //
+      trace_thread (),
+      Micro (_start - log.start).count (),
+      Micro (end - _start).count ()};
+
+    std::lock_guard<std::mutex> lock (log.mutex);
+    log.events.push_back (event);
+  }
+};
+
+inline auto write_trace () -> void
+{
+  auto& log = trace_log ();
+  if (log.path == nullptr || *log.path == '\0')
+    return;
+  auto const os = std::strcmp (log.path, "stderr") == 0 ? stderr : std::fopen (log.path, "w");
+  if (os == nullptr)
+    return;
+
+  std::lock_guard<std::mutex> lock (log.mutex);
+  fprintf (os, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  for (int i = 0; i < (int)log.events.size (); ++i) {
+    auto const& e = log.events[i];
+    fprintf (os,
+      "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+      i == 0 ? "" : ",",
+      e.name,
+      e.thread,
+      e.start_us,
+      e.duration_us);
+  }
+  fprintf (os, "\n]}\n");
+
+  if (os != stderr)
+    std::fclose (os);
+}
+
+#endif
@@ -1,23 +1,27 @@
 #include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <numeric>
 #include <random>
+#include <thread>
 
+#include <sys/resource.h>
+
+#include <asd_progetto2021/dataset/anytime_output.hpp>
 #include <asd_progetto2021/dataset/io.hpp>
-#include <asd_progetto2021/solutions/general.hpp>
-#include <asd_progetto2021/solutions/no_tour.hpp>
-#include <asd_progetto2021/solutions/selection_only.hpp>
-#include <asd_progetto2021/solutions/single_matching.hpp>
-#include <asd_progetto2021/solutions/tsp_only.hpp>
+#include <asd_progetto2021/solutions/dispatch.hpp>
+#include <asd_progetto2021/solutions/portfolio.hpp>
+#include <asd_progetto2021/utilities/telemetry.hpp>
+#include <asd_progetto2021/utilities/trace.hpp>
 
-int main ()
+int main (int argc, char** argv)
 {
   using std::chrono::duration_cast;
   using std::chrono::milliseconds;
   using std::chrono::steady_clock;
 
-  auto rng = std::mt19937 (std::random_device {}());
   auto const timer = Timer ();
 
   std::ios_base::sync_with_stdio (false);
@@ -32,74 +36,75 @@ int main ()
   auto os = stdout;
 #endif
 
-  auto const data = read_dataset (is);
-
-  auto const tour_does_not_matter = [&] () {
-    if (data.glove_resistance () == 0.0)
-      return true;
-
-    for (int i = 0; i < data.num_cities (); ++i)
-      for (int j = 0; j < i; ++j)
-        if (data.distance (i, j) != data.distance (0, 1))
-          return false;
-
-    return true;
-  }();
-
-  auto const stones_dont_matter = [&] () {
-    if (data.glove_capacity () == 0)
-      return true;
-
-    for (int i = 0; i < data.num_stones (); ++i)
-      if (data.cities_with_stone (i).size () > 0)
-        return false;
-
-    return true;
-  }();
-
-  auto const only_one_matching = [&] () {
-    for (int i = 0; i < data.num_stones (); ++i)
-      if (data.cities_with_stone (i).size () > 1)
-        return false;
-
-    return true;
-  }();
-
-  // =============
-
-  if (tour_does_not_matter && only_one_matching) {
-    auto selected = solve_selection_only (data, rng);
-    auto route = SimpleRoute (data);
-    auto matching = StoneMatching (data);
-    for (auto i : selected)
-      matching.match (i, data.cities_with_stone (i).at (0));
-    write_output (os, route, matching);
-    return 0;
-  }
-
-  if (stones_dont_matter) {
-    // find a good tour
-    auto tour = solve_tsp_only (data, rng, 4900.0 - timer.elapsed_ms ());
-    auto matching = StoneMatching (data);
-    write_output (os, tour, matching);
+  // --threads n runs n solvers side by side and keeps the best solution. Under a cpu time limit
+  // they split the budget, otherwise every solver gets all of it, which only fits a wall time limit.
+  auto threads = 1;
+  for (int i = 1; i + 1 < argc; ++i)
+    if (std::strcmp (argv[i], "--threads") == 0)
+      threads = std::max (1, std::min (std::atoi (argv[i + 1]), (int)std::thread::hardware_concurrency ()));
+
+  // --seed s makes the random choices reproducible, the solvers still stop on time so the
+  // results can differ with the load of the machine
+  auto seed = std::uint64_t (std::random_device {}());
+  for (int i = 1; i + 1 < argc; ++i)
+    if (std::strcmp (argv[i], "--seed") == 0)
+      seed = std::strtoull (argv[i + 1], nullptr, 10);
+  auto rng = Random (seed);
+
+  auto const data = read_dataset (is, seed);
+
+  auto const kind = choose_solver (data);
+
+  // With a soft cpu time limit, SIGXCPU writes the best solution published so far, so the solvers
+  // can run up to the limit instead of a hard coded budget. The identity tour without stones is
+  // published first, so the output is never empty. The solvers that run up to the budget publish
+  // their solutions as they improve, solve_no_tour and solve_selection_only don't take a budget.
+  auto budget_ms = 4900.0;
+  auto limit = rlimit ();
+  auto const anytime = getrlimit (RLIMIT_CPU, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY;
+  if (anytime)
+    budget_ms = limit.rlim_cur * 1000.0 - 20.0;
+
+  AnytimeOutput output (data, fileno (os));
+  if (anytime)
+    output.install ();
+  output.publish (SimpleRoute (data), StoneMatching (data));
+
+  auto const finish = [&] (SimpleRoute const& route, StoneMatching const& matching) {
+    output.publish (route, matching);
+    output.flush ();
+    dump_telemetry ();
+    TRACE_WRITE ();
     return 0;
-  }
+  };
 
-  if (tour_does_not_matter) {
-    // find a complete matching and selection
-    auto matching = solve_no_tour (data, rng, 4900.0 - timer.elapsed_ms ());
-    auto route = SimpleRoute (data);
-    write_output (os, route, matching);
-    return 0;
-  }
+  // =============
 
-  if (only_one_matching) {
-    // find a good selection and tour
-    auto sol = solve_single_matching (data, rng, 4900.0 - timer.elapsed_ms ());
-    write_output (os, sol.first, sol.second);
-    return 0;
+  if (threads > 1 && kind != SolverKind::selection_only) {
+    auto const specialized = [&] (Random& rng, double allowed_ms) {
+      return solve_with (kind, data, rng, allowed_ms, &output);
+    };
+    auto const general = [&] (Random& rng, double allowed_ms) {
+      return solve_general (data, rng, allowed_ms, &output);
+    };
+
+    // the specialized solver first, then the general one where it can do better
+    auto solvers = std::vector<PortfolioSolver> {specialized};
+    if (kind == SolverKind::no_tour || kind == SolverKind::single_matching)
+      solvers.push_back (general);
+
+    // one solver per thread, the ones repeated differ by the seed
+    auto portfolio = std::vector<PortfolioSolver> ();
+    for (int k = 0; k < threads; ++k)
+      portfolio.push_back (solvers[k % solvers.size ()]);
+
+    // the cpu time limit is on the whole process, shared by the solvers
+    auto const allowed_ms = (budget_ms - timer.elapsed_ms ()) / (anytime ? threads : 1);
+    ThreadPool pool (threads - 1);
+    auto sol = solve_portfolio (pool, portfolio, seed, allowed_ms);
+    return finish (sol.first, sol.second);
   }
 
-  auto sol = solve_general (data, rng, 4900.0 - timer.elapsed_ms ());
-  write_output (os, sol.first, sol.second);
+  auto sol = solve_with (kind, data, rng, budget_ms - timer.elapsed_ms (), &output);
+  return finish (sol.first, sol.second);
 }
\ No newline at end of file